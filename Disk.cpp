@@ -11,6 +11,8 @@
 
 #include "Disk.h"
 #include "dthread.h"
+#include "Metrics.h"
+#include "Trace.h"
 
 using namespace std;
 
@@ -18,6 +20,9 @@ Disk::Disk(string imageFile, int blockSize) {
   this->imageFile = imageFile;
   this->blockSize = blockSize;
   this->isInTransaction = false;
+  this->isDirty = false;
+  this->isRestoring = false;
+  this->rollbacks = 0;
   
   struct stat stat;
   int imageFileDescriptor = open(imageFile.c_str(), O_RDONLY);
@@ -49,6 +54,8 @@ int Disk::numberOfBlocks() {
 }
 
 void Disk::readBlock(int blockNumber, void *buffer) {
+  TraceSpan span("read block");
+  span.arg("block", blockNumber);
   if (blockNumber < 0 || blockNumber >= this->numberOfBlocks()) {
     cerr << "Invalid block number " << blockNumber << endl;
     exit(1);
@@ -73,17 +80,21 @@ void Disk::readBlock(int blockNumber, void *buffer) {
     cerr << "Could not read file" << endl;
     exit(1);
   }
+  Metrics::count(Metrics::BLOCK_READS);
+  Metrics::count(Metrics::DISK_SYSCALLS, 4);  // open, lseek, read, close
 
   close(fd);
 }
 
 void Disk::writeBlock(int blockNumber, void *buffer) {  
+  TraceSpan span("write block");
+  span.arg("block", blockNumber);
   if (blockNumber < 0 || blockNumber >= this->numberOfBlocks()) {
     cerr << "Invalid block number " << blockNumber << endl;
     exit(1);
   }
 
-  if (isInTransaction) {
+  if (isInTransaction && !isRestoring && undoBlocks.insert(blockNumber).second) {
     struct UndoRecord undoRecord;
     undoRecord.blockNumber = blockNumber;
     undoRecord.blockData = new unsigned char[blockSize];
@@ -110,8 +121,34 @@ void Disk::writeBlock(int blockNumber, void *buffer) {
     cerr << "Could not write file" << endl;
     exit(1);
   }
+  Metrics::count(Metrics::BLOCK_WRITES);
+  Metrics::count(Metrics::DISK_SYSCALLS, 4);  // open, lseek, write, close
+  if (isInTransaction) {
+    isDirty = true;
+  } else {
+    TraceSpan fsyncSpan("fsync");
+    fsync(fd);
+    Metrics::count(Metrics::FSYNCS);
+    Metrics::count(Metrics::DISK_SYSCALLS);
+  }
+  close(fd);
+}
+
+void Disk::sync() {
+  if (!isDirty) {
+    return;
+  }
+  TraceSpan span("fsync");
+  int fd = open(this->imageFile.c_str(), O_RDWR);
+  if (fd < 0) {
+    cerr << "Could not open image file " << this->imageFile << endl;
+    exit(1);
+  }
   fsync(fd);
   close(fd);
+  isDirty = false;
+  Metrics::count(Metrics::FSYNCS);
+  Metrics::count(Metrics::DISK_SYSCALLS, 3);  // open, fsync, close
 }
 
 void Disk::beginTransaction() {
@@ -123,20 +160,44 @@ void Disk::beginTransaction() {
 }
 
 void Disk::commit() {
+  sync();
   isInTransaction = false;
   deque<struct UndoRecord>::iterator iter;
   for (iter = undoLog.begin(); iter != undoLog.end(); iter++) {
     delete [] iter->blockData;
   }
   undoLog.clear();
+  undoBlocks.clear();
 }
 
 void Disk::rollback() {
+  rollbackTo(0);
+  sync();
   isInTransaction = false;
-  deque<struct UndoRecord>::iterator iter;
-  for (iter = undoLog.begin(); iter != undoLog.end(); iter++) {
-    this->writeBlock(iter->blockNumber, iter->blockData);
-    delete [] iter->blockData;
+}
+
+size_t Disk::savepoint() {
+  undoBlocks.clear();
+  return undoLog.size();
+}
+
+// Newest records first, so a block written in several savepoints ends up
+// as it was before the oldest of them
+void Disk::rollbackTo(size_t savepoint) {
+  if (undoLog.size() > savepoint) {
+    rollbacks++;
   }
-  undoLog.clear();
+  isRestoring = true;
+  while (undoLog.size() > savepoint) {
+    struct UndoRecord undoRecord = undoLog.front();
+    undoLog.pop_front();
+    this->writeBlock(undoRecord.blockNumber, undoRecord.blockData);
+    delete [] undoRecord.blockData;
+  }
+  isRestoring = false;
+  undoBlocks.clear();
+}
+
+unsigned long Disk::generation() {
+  return rollbacks;
 }
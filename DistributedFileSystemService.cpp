@@ -1,142 +1,820 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <sstream>
 #include <iostream>
 #include <map>
 #include <string>
 #include <algorithm>
+#include <time.h>
 
 #include "DistributedFileSystemService.h"
 #include "ClientError.h"
 #include "ufs.h"
 #include "WwwFormEncodedDict.h"
+#include "dthread.h"
+#include "Gzip.h"
+#include "HttpUtils.h"
+#include "Metrics.h"
 
 using namespace std;
 
+// Holds the service lock until the end of the scope, however it's left
+class FileSystemLock {
+ public:
+    FileSystemLock(pthread_mutex_t *mutex) : mutex(mutex) { dthread_mutex_lock(mutex); }
+    ~FileSystemLock() { dthread_mutex_unlock(mutex); }
+ private:
+    pthread_mutex_t *mutex;
+};
+
+// Runs the rest of the scope in a disk transaction, which is rolled back
+// unless commit() is reached, whatever is thrown on the way out
+class DiskTransaction {
+ public:
+    DiskTransaction(Disk *disk) : disk(disk), committed(false) { disk->beginTransaction(); }
+    ~DiskTransaction() {
+        if (!committed) {
+            disk->rollback();
+        }
+    }
+    void commit() {
+        disk->commit();
+        committed = true;
+    }
+ private:
+    Disk *disk;
+    bool committed;
+};
+
+// Turns a failed LocalFileSystem create, write, copy or rename into the error the client sees
+static void throwOnError(int ret) {
+    if (ret == -ENOTFOUND) {
+        throw ClientError::notFound();
+    } else if (ret == -EINVALIDNAME) {
+        throw ClientError::badRequest();
+    } else if (ret == -ENOTENOUGHSPACE || ret == -EINVALIDSIZE) {
+        throw ClientError::insufficientStorage();
+    } else if (ret == -ECORRUPT) {
+        throw runtime_error("block checksum mismatch");  // the server's fault, a 500
+    } else if (ret < 0) {
+        throw ClientError::conflict();
+    }
+}
+
+// Splits a header naming another object (Destination, x-copy-source) into
+// path components. The value is either a path or an absolute URL; only the
+// part under this service's prefix matters.
+static vector<string> headerPath(HTTPRequest *request, string header, string prefix) {
+    string_view value;
+    if (!request->findHeader(header, &value)) {
+        throw ClientError::badRequest();
+    }
+    string target(value);
+
+    size_t scheme = target.find("://");
+    if (scheme != string::npos) {
+        size_t pathStart = target.find('/', scheme + 3);
+        target = pathStart == string::npos ? "/" : target.substr(pathStart);
+    }
+    if (target.compare(0, prefix.size(), prefix) != 0) {
+        throw ClientError::badRequest();
+    }
+    return StringUtils::split(target.substr(prefix.size()), '/');
+}
+
+// A strong ETag naming the inode and its version. Inode numbers get reused,
+// but versions carry on across owners, so the pair never repeats.
+static string entityTag(int inodeNumber, unsigned long long version) {
+    char tag[48];
+    snprintf(tag, sizeof(tag), "\"%x-%llx\"", inodeNumber, version);
+    return tag;
+}
+
+static bool parseHttpDate(string date, long long *seconds) {
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char *end = strptime(date.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == NULL || *end != '\0') {
+        return false;
+    }
+    *seconds = timegm(&tm);
+    return true;
+}
+
+// A tag without the suffix of a gzip variant (see gzipTag), which names
+// the same version
+static string baseTag(const string &tag) {
+    if (tag.size() > 4 && tag.compare(tag.size() - 4, 4, "-gz\"") == 0) {
+        return tag.substr(0, tag.size() - 4) + "\"";
+    }
+    return tag;
+}
+
+// Whether an If-Match or If-None-Match list names tag. If-None-Match compares
+// weakly (a W/ prefix is ignored), If-Match strongly.
+static bool tagListMatches(string list, string tag, bool weak) {
+    for (string candidate : StringUtils::split(list, ',')) {
+        size_t start = candidate.find_first_not_of(" \t");
+        size_t end = candidate.find_last_not_of(" \t");
+        if (start == string::npos) {
+            continue;
+        }
+        candidate = candidate.substr(start, end - start + 1);
+        if (weak && candidate.compare(0, 2, "W/") == 0) {
+            candidate = candidate.substr(2);
+        }
+        if (candidate == "*" || baseTag(candidate) == baseTag(tag)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// The ETag of a file, or "" if it has none (images without versions, or a
+// directory, whose listing changes without its version moving)
+static string currentTag(LocalFileSystem *fileSystem, int inodeNumber, long long *mtime) {
+    inode_t inode;
+    unsigned long long version;
+    if (inodeNumber < 0 || fileSystem->stat(inodeNumber, &inode) < 0 || inode.type != UFS_REGULAR_FILE ||
+        fileSystem->getVersion(inodeNumber, &version, mtime) < 0 || version == 0) {
+        return "";
+    }
+    return entityTag(inodeNumber, version);
+}
+
+// If-Match and If-None-Match for requests that change the file inodeNumber
+// (negative if it doesn't exist yet). Checked before anything is written.
+// A "*" matches any existing file; a file without an ETag matches no tag.
+static void checkPreconditions(LocalFileSystem *fileSystem, HTTPRequest *request, int inodeNumber) {
+    long long mtime;
+    string tag = currentTag(fileSystem, inodeNumber, &mtime);
+    string_view value;
+    if (request->findHeader("If-Match", &value) &&
+        !(inodeNumber >= 0 && tagListMatches(string(value), tag, false))) {
+        throw ClientError::preconditionFailed();
+    }
+    if (request->findHeader("If-None-Match", &value) &&
+        inodeNumber >= 0 && tagListMatches(string(value), tag, true)) {
+        throw ClientError::preconditionFailed();
+    }
+}
+
+// The inode a request path names, or a negative error if it doesn't exist
+static int resolvePath(LocalFileSystem *fileSystem, string path) {
+    int currentInode = UFS_ROOT_DIRECTORY_INODE_NUMBER;
+    for (const string &component : StringUtils::split(path, '/')) {
+        if (!component.empty()) {
+            currentInode = fileSystem->lookup(currentInode, component);
+        }
+    }
+    return currentInode;
+}
+
+// The body of a GET on a directory: its names, sorted, one per line, with
+// a / after subdirectories. "." and ".." are not listed.
+static string directoryListing(LocalFileSystem *fileSystem, int inodeNumber) {
+    vector<DirectoryEntry> entries;
+    if (fileSystem->readDirectory(inodeNumber, entries) < 0) throw ClientError::notFound();
+
+    vector<string> names;
+    for (const DirectoryEntry &entry : entries) {
+        string name = entry.name;
+        if (name != "." && name != "..") {
+            inode_t inode;
+            if (fileSystem->stat(entry.inum, &inode) == 0 && inode.type == UFS_DIRECTORY) {
+                name += "/";
+            }
+            names.push_back(name);
+        }
+    }
+    sort(names.begin(), names.end());
+
+    stringstream body;
+    for (const string &name : names) {
+        body << name << "\n";
+    }
+    return body.str();
+}
+
+// The body of a GET on inodeNumber: a file's bytes or a directory's listing
+static string objectBody(LocalFileSystem *fileSystem, int inodeNumber, const inode_t &inode) {
+    if (inode.type == UFS_DIRECTORY) {
+        return directoryListing(fileSystem, inodeNumber);
+    }
+
+    // Read straight into the body rather than through a buffer
+    string body(inode.size, '\0');
+    int bytesRead = fileSystem->read(inodeNumber, &body[0], inode.size);
+    if (bytesRead == -ECORRUPT) throwOnError(bytesRead);
+    if (bytesRead < 0) throw ClientError::notFound();
+    body.resize(bytesRead);
+    return body;
+}
+
+// The directory named by components, which must all exist
+static int lookupDirectory(LocalFileSystem *fileSystem, const vector<string> &components) {
+    int currentInode = UFS_ROOT_DIRECTORY_INODE_NUMBER;
+    for (const string &component : components) {
+        if (!component.empty()) {
+            currentInode = fileSystem->lookup(currentInode, component);
+            if (currentInode < 0) throw ClientError::notFound();
+        }
+    }
+    return currentInode;
+}
+
+// The file fileName in the directory named by components, creating it and
+// any directories on the way that don't exist yet
+static int createFile(LocalFileSystem *fileSystem, const vector<string> &components, string fileName) {
+    int currentInode = UFS_ROOT_DIRECTORY_INODE_NUMBER;
+    for (const string &component : components) {
+        if (!component.empty()) {
+            int nextInode = fileSystem->lookup(currentInode, component);
+            if (nextInode < 0) {  // Create directory if it doesn't exist
+                currentInode = fileSystem->create(currentInode, UFS_DIRECTORY, component);
+                throwOnError(currentInode);
+            } else {
+                inode_t inode;
+                fileSystem->stat(nextInode, &inode);
+                if (inode.type != UFS_DIRECTORY) {
+                    throw ClientError::conflict();
+                }
+                currentInode = nextInode;
+            }
+        }
+    }
+
+    int fileInode = fileSystem->lookup(currentInode, fileName);
+    if (fileInode < 0) {  // File does not exist
+        fileInode = fileSystem->create(currentInode, UFS_REGULAR_FILE, fileName);
+        throwOnError(fileInode);
+    }
+    return fileInode;
+}
+
+// Sets ETag and Last-Modified when there is a tag and answers If-None-Match,
+// or failing that If-Modified-Since. Returns true (with the status set to
+// 304) when the client's copy is current.
+static bool sendValidators(HTTPRequest *request, HTTPResponse *response, string tag, long long mtime) {
+    if (tag.empty()) {
+        return false;
+    }
+    response->setHeader("ETag", tag);
+    response->setHeader("Last-Modified", HttpUtils::httpDate(mtime));
+
+    long long since;
+    bool notModified;
+    string_view value;
+    if (request->findHeader("If-None-Match", &value)) {
+        notModified = tagListMatches(string(value), tag, true);
+    } else {
+        notModified = request->findHeader("If-Modified-Since", &value) &&
+            parseHttpDate(string(value), &since) && mtime <= since;
+    }
+    if (notModified) {
+        response->setStatus(304);
+    }
+    return notModified;
+}
+
+// The ETag of the gzip variant of the response tagged tag. The choice to
+// compress depends only on the path and the body's length, so one version
+// always gives the same variant under this tag.
+static string gzipTag(const string &tag) {
+    return tag.empty() ? tag : tag.substr(0, tag.size() - 1) + "-gz\"";
+}
+
+// Bodies smaller than this aren't worth compressing
+static const size_t MIN_GZIP_BYTES = 256;
+
+// The object cache key of a request path: its components joined with
+// single slashes, so /a//b/ and /a/b share an entry
+static string cacheKey(string path) {
+    string key;
+    for (const string &component : StringUtils::split(path, '/')) {
+        if (!component.empty()) {
+            key += "/" + component;
+        }
+    }
+    return key.empty() ? "/" : key;
+}
+
 DistributedFileSystemService::DistributedFileSystemService(string diskFile) : HttpService("/ds3/") {
     this->fileSystem = new LocalFileSystem(new Disk(diskFile, UFS_BLOCK_SIZE));
+    pthread_mutex_init(&this->lock, NULL);
+    this->scrubRate = 0;
+    this->cache = NULL;
+    this->gzipCache = NULL;
+}
+
+void DistributedFileSystemService::enableCache(size_t capacity) {
+    if (capacity > 0) {
+        this->cache = new ObjectCache(capacity);
+
+        // The cache is only touched under the lock, so read it under the lock
+        ObjectCache *cache = this->cache;
+        pthread_mutex_t *lock = &this->lock;
+        Metrics::addCounter("gunrock_cache_hits_total", "GET and HEAD responses served from the cache",
+                            [cache, lock]() { FileSystemLock held(lock); return cache->hits(); });
+        Metrics::addCounter("gunrock_cache_misses_total", "GET and HEAD requests the cache couldn't answer",
+                            [cache, lock]() { FileSystemLock held(lock); return cache->misses(); });
+        Metrics::addCounter("gunrock_cache_evictions_total", "Cache entries evicted to make room",
+                            [cache, lock]() { FileSystemLock held(lock); return cache->evictions(); });
+    }
+}
+
+void DistributedFileSystemService::enableCompression(size_t capacity) {
+    this->gzipCache = new ObjectCache(capacity);
+
+    ObjectCache *cache = this->gzipCache;
+    pthread_mutex_t *lock = &this->lock;
+    Metrics::addCounter("gunrock_gzip_cache_hits_total", "Gzipped bodies served from the compressed cache",
+                        [cache, lock]() { FileSystemLock held(lock); return cache->hits(); });
+    Metrics::addCounter("gunrock_gzip_cache_misses_total", "Bodies gzipped on the fly",
+                        [cache, lock]() { FileSystemLock held(lock); return cache->misses(); });
+}
+
+bool DistributedFileSystemService::negotiateGzip(HTTPRequest *request, HTTPResponse *response,
+                                                 const string &path, bool directory, size_t bodyLength) {
+    static const char *textTypes[] = {".txt", ".html", ".htm", ".css", ".js", ".json", ".csv", ".xml",
+                                      ".svg", ".md", ".log"};
+    if (gzipCache == NULL || bodyLength < MIN_GZIP_BYTES) {
+        return false;
+    }
+    bool text = directory;
+    for (const char *type : textTypes) {
+        size_t length = strlen(type);
+        text = text || (path.size() > length && path.compare(path.size() - length, length, type) == 0);
+    }
+    if (!text) {
+        return false;
+    }
+    response->setHeader("Vary", "Accept-Encoding");
+    return request->acceptsEncoding("gzip");
+}
+
+const string *DistributedFileSystemService::cachedGzip(const string &tag) {
+    const CachedObject *cached = tag.empty() ? NULL : gzipCache->get(tag);
+    return cached != NULL ? &cached->body : NULL;
+}
+
+string DistributedFileSystemService::gzipAndKeep(const string &body, const string &tag) {
+    string compressed = Gzip::compress(body.data(), body.size());
+    if (!tag.empty()) {
+        CachedObject object = {compressed, false, tag, 0};
+        gzipCache->put(tag, object);
+    }
+    return compressed;
+}
+
+void DistributedFileSystemService::sendGzipLength(HTTPResponse *response, const string &tag) {
+    const string *cached = cachedGzip(tag);
+    response->setContentEncoding("gzip");
+    if (cached != NULL) {
+        response->setHeader("Content-Length", to_string(cached->size()));
+    } else {
+        response->withoutLength();
+    }
+}
+
+void DistributedFileSystemService::sendBody(HTTPResponse *response, string body, const string &tag, bool gzip) {
+    if (!gzip) {
+        response->setBody(std::move(body));
+        return;
+    }
+    const string *cached = cachedGzip(tag);
+    response->setContentEncoding("gzip");
+    response->setBody(cached != NULL ? *cached : gzipAndKeep(body, tag));
+}
+
+void DistributedFileSystemService::startScrubber(int blocksPerSecond) {
+    super_t super;
+    fileSystem->readSuperBlock(&super);
+    if (!(super.features & UFS_FEATURE_CHECKSUMS) || blocksPerSecond <= 0) {
+        return;
+    }
+
+    this->scrubRate = blocksPerSecond;
+    pthread_t thread;
+    dthread_create(&thread, NULL, scrubLoop, this);
+    dthread_detach(thread);
+}
+
+// Walks the inodes round and round, one file per turn of the lock, and
+// sleeps after each file for as long as its blocks are worth at the scrub
+// rate. Files that are read get checked by read() anyway; this finds the
+// corruption in the ones nobody reads.
+void *DistributedFileSystemService::scrubLoop(void *arg) {
+    DistributedFileSystemService *service = static_cast<DistributedFileSystemService *>(arg);
+    map<int, int> reported;  // corrupt block counts already logged, by inode
+    int inodeNumber = 0;
+    while (true) {
+        int blocks = 1;  // free and non-file inodes still cost a little
+        {
+            FileSystemLock guard(&service->lock);
+            super_t super;
+            service->fileSystem->readSuperBlock(&super);
+            inodeNumber = inodeNumber % super.num_inodes;
+
+            inode_t inode;
+            int corrupt = service->fileSystem->scrub(inodeNumber);
+            if (corrupt >= 0 && service->fileSystem->stat(inodeNumber, &inode) == 0) {
+                blocks = max(1, (inode.size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE);
+            }
+            if (corrupt > 0 && reported[inodeNumber] != corrupt) {
+                cerr << "scrub: inode " << inodeNumber << " has " << corrupt << " corrupt block(s)" << endl;
+            }
+            reported[inodeNumber] = max(corrupt, 0);
+            inodeNumber++;
+        }
+        usleep((useconds_t) (1000000LL * blocks / service->scrubRate));
+    }
+    return NULL;
+}
+
+void DistributedFileSystemService::head(HTTPRequest *request, HTTPResponse *response) {
+    FileSystemLock guard(&this->lock);
+    string path = request->getPath().substr(this->pathPrefix().size());
+
+    // Everything a GET would say but the body, from the cache or the inode
+    // alone. Only a directory's length needs its blocks, to size the listing.
+    // The length and validators are those of the variant GET would send.
+    // A gzip length is only sent when the compressed body is cached; HEAD
+    // doesn't compress anything to find it.
+    stringstream length;
+    const CachedObject *cached = cache != NULL ? cache->get(cacheKey(path)) : NULL;
+    if (cached != NULL) {
+        response->setHeader("X-DS3-Cache", "hit");
+        response->setHeader("X-DS3-Type", cached->directory ? "directory" : "file");
+        bool gzip = negotiateGzip(request, response, path, cached->directory, cached->body.size());
+        if (sendValidators(request, response, gzip ? gzipTag(cached->etag) : cached->etag, cached->mtime)) {
+            return;
+        }
+        if (gzip) {
+            sendGzipLength(response, cached->etag);
+            return;
+        }
+        length << cached->body.size();
+        response->setHeader("Content-Length", length.str());
+        return;
+    }
+    if (cache != NULL) {
+        response->setHeader("X-DS3-Cache", "miss");
+    }
+
+    int currentInode = resolvePath(fileSystem, path);
+    inode_t inode;
+    if (fileSystem->stat(currentInode, &inode) < 0) {
+        throw ClientError::notFound();
+    }
+
+    if (inode.type == UFS_REGULAR_FILE) {
+        response->setHeader("X-DS3-Type", "file");
+        long long mtime;
+        string tag = currentTag(fileSystem, currentInode, &mtime);
+        bool gzip = negotiateGzip(request, response, path, false, inode.size);
+        if (sendValidators(request, response, gzip ? gzipTag(tag) : tag, mtime)) {
+            return;
+        }
+        if (gzip) {
+            sendGzipLength(response, tag);
+            return;
+        }
+        length << inode.size;
+    } else {
+        response->setHeader("X-DS3-Type", "directory");
+        string listing = directoryListing(fileSystem, currentInode);
+        if (negotiateGzip(request, response, path, true, listing.size())) {
+            sendGzipLength(response, "");
+            return;
+        }
+        length << listing.size();
+    }
+    response->setHeader("Content-Length", length.str());
 }
 
 void DistributedFileSystemService::get(HTTPRequest *request, HTTPResponse *response) {
+    FileSystemLock guard(&this->lock);
     string path = request->getPath().substr(this->pathPrefix().size());
-    vector<string> components = StringUtils::split(path, '/');
-    int currentInode = UFS_ROOT_DIRECTORY_INODE_NUMBER;
 
-    try {
-        for (const string &component : components) {
-            if (!component.empty()) {
-                currentInode = fileSystem->lookup(currentInode, component);
-            }
+    // A hit is served without looking up the path or reading a block
+    const CachedObject *cached = cache != NULL ? cache->get(cacheKey(path)) : NULL;
+    if (cached != NULL) {
+        response->setHeader("X-DS3-Cache", "hit");
+        bool gzip = negotiateGzip(request, response, path, cached->directory, cached->body.size());
+        if (!sendValidators(request, response, gzip ? gzipTag(cached->etag) : cached->etag, cached->mtime)) {
+            sendBody(response, cached->body, cached->etag, gzip);
         }
+        return;
+    }
+    if (cache != NULL) {
+        response->setHeader("X-DS3-Cache", "miss");
+    }
 
+    int currentInode = resolvePath(fileSystem, path);
+    try {
         inode_t inode;
         if (fileSystem->stat(currentInode, &inode) < 0) {
             throw ClientError::notFound();
         }
 
-        if (inode.type == UFS_REGULAR_FILE) {
-            char buffer[inode.size];
-            int bytesRead = fileSystem->read(currentInode, buffer, inode.size);
-            if (bytesRead < 0) throw ClientError::notFound();
-            response->setBody(string(buffer, bytesRead));
-        } else if (inode.type == UFS_DIRECTORY) {
-            unsigned char dirBuffer[inode.size];
-            int bytesRead = fileSystem->read(currentInode, dirBuffer, inode.size);
-            if (bytesRead < 0) throw ClientError::notFound();
-
-            dir_ent_t *entries = reinterpret_cast<dir_ent_t *>(dirBuffer);
-            int numEntries = bytesRead / sizeof(dir_ent_t);
-
-            stringstream body;
-            for (int i = 0; i < numEntries; i++) {
-                if (entries[i].inum != 0) {
-                    body << entries[i].name;
-                    if (fileSystem->stat(entries[i].inum, &inode) == 0 && inode.type == UFS_DIRECTORY) {
-                        body << "/";
-                    }
-                    body << "\n";
-                }
-            }
+        CachedObject object;
+        object.directory = inode.type == UFS_DIRECTORY;
+        object.mtime = 0;
+        if (object.directory) {
+            object.body = objectBody(fileSystem, currentInode, inode);
+        } else {
+            object.etag = currentTag(fileSystem, currentInode, &object.mtime);
+        }
+        // A file's length is in its inode, so its variant and tag are known,
+        // and a 304 sent, before any of its blocks are read
+        bool gzip = negotiateGzip(request, response, path, object.directory,
+                                  object.directory ? object.body.size() : inode.size);
+        if (sendValidators(request, response, gzip ? gzipTag(object.etag) : object.etag, object.mtime)) {
+            return;
+        }
+        if (!object.directory) {
+            object.body = objectBody(fileSystem, currentInode, inode);
+        }
 
-            response->setBody(body.str());
+        if (cache != NULL) {
+            cache->put(cacheKey(path), object);
         }
+        sendBody(response, std::move(object.body), object.etag, gzip);
     } catch (ClientError &e) {
         throw e;  // Re-throw for framework handling
     }
 }
 
 void DistributedFileSystemService::put(HTTPRequest *request, HTTPResponse *response) {
+    FileSystemLock guard(&this->lock);
     string path = request->getPath().substr(this->pathPrefix().size());
     vector<string> components = StringUtils::split(path, '/');
-    int currentInode = UFS_ROOT_DIRECTORY_INODE_NUMBER;
     string fileName = components.back();
     components.pop_back();
 
-    // Comment out or implement transaction handling
-    // this->fileSystem->disk->beginTransaction();
-    try {
+    // Whatever happens below, the file, its directories' listings and
+    // anything cached under the path can't be trusted any more
+    if (cache != NULL) {
+        cache->invalidate(cacheKey(path));
+    }
+
+    // Creating the file and its directories and writing it all happen or
+    // none of it does
+    DiskTransaction transaction(this->fileSystem->disk);
+
+    // Conditional PUT: the file as it is now, without creating anything
+    if (request->hasHeader("If-Match") || request->hasHeader("If-None-Match")) {
+        int existing = UFS_ROOT_DIRECTORY_INODE_NUMBER;
         for (const string &component : components) {
-            if (!component.empty()) {
-                int nextInode = fileSystem->lookup(currentInode, component);
-                if (nextInode < 0) {  // Create directory if it doesn't exist
-                    currentInode = fileSystem->create(currentInode, UFS_DIRECTORY, component);
-                } else {
-                    inode_t inode;
-                    fileSystem->stat(nextInode, &inode);
-                    if (inode.type != UFS_DIRECTORY) {
-                        throw ClientError::conflict();
-                    }
-                    currentInode = nextInode;
-                }
+            if (!component.empty() && existing >= 0) {
+                existing = fileSystem->lookup(existing, component);
             }
         }
+        if (existing >= 0) {
+            existing = fileSystem->lookup(existing, fileName);
+        }
+        checkPreconditions(fileSystem, request, existing);
+    }
 
-        int fileInode = fileSystem->lookup(currentInode, fileName);
-        if (fileInode < 0) {  // File does not exist
-            fileInode = fileSystem->create(currentInode, UFS_REGULAR_FILE, fileName);
+    // Find the source of a copy before creating anything
+    bool copySource = request->hasHeader("x-copy-source");
+    int srcInode = UFS_ROOT_DIRECTORY_INODE_NUMBER;
+    if (copySource) {
+        for (const string &component : headerPath(request, "x-copy-source", this->pathPrefix())) {
+            srcInode = fileSystem->lookup(srcInode, component);
+            if (srcInode < 0) throw ClientError::notFound();
         }
 
+        inode_t inode;
+        if (fileSystem->stat(srcInode, &inode) < 0 || inode.type != UFS_REGULAR_FILE) {
+            throw ClientError::conflict();  // only files can be copied
+        }
+    }
+
+    int fileInode = createFile(fileSystem, components, fileName);
+
+    if (copySource) {
+        // Server-side copy: the file shares the source's blocks instead
+        // of the client sending the data again
+        throwOnError(fileSystem->copy(srcInode, fileInode));
+    } else if (request->getParams().count("append")) {
+        // PUT ?append adds the body to the end of the file
         string body = request->getBody();
-        fileSystem->write(fileInode, body.c_str(), body.size());
-        // this->fileSystem->disk->commitTransaction();
-    } catch (ClientError &e) {
-        // this->fileSystem->disk->rollbackTransaction();
-        throw e;
+        throwOnError(fileSystem->append(fileInode, body.c_str(), body.size()));
+    } else {
+        string body = request->getBody();
+        throwOnError(fileSystem->write(fileInode, body.c_str(), body.size()));
     }
+
+    long long mtime;
+    string tag = currentTag(fileSystem, fileInode, &mtime);
+    if (!tag.empty()) {
+        response->setHeader("ETag", tag);
+    }
+    transaction.commit();
 }
 
 void DistributedFileSystemService::del(HTTPRequest *request, HTTPResponse *response) {
+    FileSystemLock guard(&this->lock);
     string path = request->getPath().substr(this->pathPrefix().size());
     vector<string> components = StringUtils::split(path, '/');
-    int currentInode = UFS_ROOT_DIRECTORY_INODE_NUMBER;
     string targetName = components.back();
     components.pop_back();
 
-    // Comment out or implement transaction handling
-    // this->fileSystem->disk->beginTransaction();
-    try {
-        for (const string &component : components) {
-            if (!component.empty()) {
-                currentInode = fileSystem->lookup(currentInode, component);
-                if (currentInode < 0) throw ClientError::notFound();
+    if (cache != NULL) {
+        cache->invalidate(cacheKey(path));
+    }
+
+    DiskTransaction transaction(this->fileSystem->disk);
+    int currentInode = lookupDirectory(fileSystem, components);
+    int targetInode = fileSystem->lookup(currentInode, targetName);
+    if (targetInode < 0) throw ClientError::notFound();
+    checkPreconditions(fileSystem, request, targetInode);
+
+    // unlink refuses to remove a directory that still has entries
+    if (fileSystem->unlink(currentInode, targetName) == -EDIRNOTEMPTY) {
+        throw ClientError::conflict();
+    }
+    transaction.commit();
+}
+void DistributedFileSystemService::move(HTTPRequest *request, HTTPResponse *response) {
+    FileSystemLock guard(&this->lock);
+    string path = request->getPath().substr(this->pathPrefix().size());
+    vector<string> components = StringUtils::split(path, '/');
+    if (components.empty()) {
+        throw ClientError::badRequest();  // the root can't move
+    }
+    string srcName = components.back();
+    components.pop_back();
+
+    vector<string> dstComponents = headerPath(request, "Destination", this->pathPrefix());
+    if (dstComponents.empty()) {
+        throw ClientError::badRequest();
+    }
+    string dstName = dstComponents.back();
+    dstComponents.pop_back();
+
+    // Both ends of the move, and everything under them, change
+    if (cache != NULL) {
+        cache->invalidate(cacheKey(path));
+        string dstPath;
+        for (const string &component : dstComponents) {
+            dstPath += component + "/";
+        }
+        cache->invalidate(cacheKey(dstPath + dstName));
+    }
+
+    // Creating missing destination directories and relinking the entry
+    // either both happen or neither does
+    DiskTransaction transaction(this->fileSystem->disk);
+    int srcParent = UFS_ROOT_DIRECTORY_INODE_NUMBER;
+    for (const string &component : components) {
+        if (!component.empty()) {
+            srcParent = fileSystem->lookup(srcParent, component);
+            if (srcParent < 0) throw ClientError::notFound();
+        }
+    }
+    if (fileSystem->lookup(srcParent, srcName) < 0) throw ClientError::notFound();
+
+    int dstParent = UFS_ROOT_DIRECTORY_INODE_NUMBER;
+    for (const string &component : dstComponents) {
+        if (!component.empty()) {
+            int nextInode = fileSystem->lookup(dstParent, component);
+            if (nextInode < 0) {  // Create directory if it doesn't exist
+                nextInode = fileSystem->create(dstParent, UFS_DIRECTORY, component);
+                throwOnError(nextInode);
+            } else {
+                inode_t inode;
+                fileSystem->stat(nextInode, &inode);
+                if (inode.type != UFS_DIRECTORY) {
+                    throw ClientError::conflict();
+                }
             }
+            dstParent = nextInode;
         }
+    }
+
+    throwOnError(fileSystem->rename(srcParent, srcName, dstParent, dstName));
+    transaction.commit();
+}
 
-        int targetInode = fileSystem->lookup(currentInode, targetName);
-        if (targetInode < 0) throw ClientError::notFound();
+// A batch body is a list of operations, each a line "METHOD PATH [LENGTH]"
+// followed by LENGTH bytes of body (PUTs only; LENGTH defaults to 0). A
+// batch that doesn't parse is rejected before any of it runs.
+vector<DistributedFileSystemService::BatchItem> DistributedFileSystemService::parseBatch(const string &body) {
+    vector<BatchItem> items;
+    size_t pos = 0;
+    while (pos < body.size()) {
+        size_t end = body.find('\n', pos);
+        if (end == string::npos) throw ClientError::badRequest();
+        stringstream line(body.substr(pos, end - pos));
+        pos = end + 1;
 
+        BatchItem item;
+        long long length = 0;
+        if (!(line >> item.method >> item.path)) throw ClientError::badRequest();
+        if (!(line >> length)) {
+            length = 0;
+        }
+        if (length < 0 || (unsigned long long) length > body.size() - pos ||
+            (length > 0 && item.method != "PUT")) {
+            throw ClientError::badRequest();
+        }
+        if (item.method != "GET" && item.method != "PUT" && item.method != "DELETE") {
+            throw ClientError::badRequest();
+        }
+        item.body = body.substr(pos, length);
+        pos += length;
+        items.push_back(std::move(item));
+    }
+    return items;
+}
+
+string DistributedFileSystemService::runBatchItem(const BatchItem &item) {
+    if (item.method == "GET") {
+        const CachedObject *cached = cache != NULL ? cache->get(cacheKey(item.path)) : NULL;
+        if (cached != NULL) {
+            return cached->body;
+        }
+
+        int inodeNumber = resolvePath(fileSystem, item.path);
         inode_t inode;
-        fileSystem->stat(targetInode, &inode);
-        if (inode.type == UFS_DIRECTORY && inode.size > 0) {
+        if (fileSystem->stat(inodeNumber, &inode) < 0) {
+            throw ClientError::notFound();
+        }
+        CachedObject object;
+        object.directory = inode.type == UFS_DIRECTORY;
+        object.mtime = 0;
+        if (inode.type == UFS_REGULAR_FILE) {
+            object.etag = currentTag(fileSystem, inodeNumber, &object.mtime);
+        }
+        object.body = objectBody(fileSystem, inodeNumber, inode);
+        if (cache != NULL) {
+            cache->put(cacheKey(item.path), object);
+        }
+        return object.body;
+    }
+
+    vector<string> components = StringUtils::split(item.path, '/');
+    if (components.empty()) {
+        throw ClientError::badRequest();  // the root can't be written or removed
+    }
+    string name = components.back();
+    components.pop_back();
+    if (cache != NULL) {
+        cache->invalidate(cacheKey(item.path));
+    }
+
+    if (item.method == "PUT") {
+        int fileInode = createFile(fileSystem, components, name);
+        throwOnError(fileSystem->write(fileInode, item.body.c_str(), item.body.size()));
+    } else {
+        int parentInode = lookupDirectory(fileSystem, components);
+        if (fileSystem->lookup(parentInode, name) < 0) throw ClientError::notFound();
+        if (fileSystem->unlink(parentInode, name) == -EDIRNOTEMPTY) {
             throw ClientError::conflict();
         }
+    }
+    return "";
+}
 
-        fileSystem->unlink(currentInode, targetName);
-        // this->fileSystem->disk->commitTransaction();
-    } catch (ClientError &e) {
-        // this->fileSystem->disk->rollbackTransaction();
-        throw e;
+// Runs the operations in order, under one hold of the lock and in one disk
+// transaction, so the whole batch costs one fsync. Each operation stands
+// on its own: one that fails is rolled back and the rest still run. The
+// response has a result for each, a line "STATUS PATH LENGTH" followed by
+// LENGTH bytes of body (what a GET would have returned).
+void DistributedFileSystemService::post(HTTPRequest *request, HTTPResponse *response) {
+    string path = request->getPath().substr(this->pathPrefix().size());
+    if (!request->getParams().count("batch") || !StringUtils::split(path, '/').empty()) {
+        throw ClientError::methodNotAllowed();
     }
-}
\ No newline at end of file
+    vector<BatchItem> items = parseBatch(request->getBody());
+
+    FileSystemLock guard(&this->lock);
+    stringstream results;
+    DiskTransaction transaction(this->fileSystem->disk);
+    for (const BatchItem &item : items) {
+        size_t savepoint = this->fileSystem->disk->savepoint();
+        int status = 200;
+        string body;
+        try {
+            body = runBatchItem(item);
+        } catch (ClientError &e) {
+            status = e.status_code;
+        } catch (...) {
+            status = 500;  // the server's fault, bad_alloc included
+        }
+        if (status != 200) {
+            this->fileSystem->disk->rollbackTo(savepoint);
+        }
+        results << status << " " << item.path << " " << body.size() << "\n" << body;
+    }
+    transaction.commit();
+
+    response->setContentType("application/x-ds3-batch");
+    response->setBody(results.str());
+}
@@ -9,9 +9,18 @@
 
 #include "FileService.h"
 #include "ClientError.h"
+#include "dthread.h"
+#include "HttpUtils.h"
+#include "StringUtils.h"
 
 using namespace std;
 
+StaticFile::~StaticFile() {
+  if (fd >= 0) {
+    close(fd);
+  }
+}
+
 FileService::FileService(string basedir) : HttpService("/") {
   while (endswith(basedir, "/")) {
     basedir = basedir.substr(0, basedir.length() - 1);
@@ -21,8 +30,10 @@ FileService::FileService(string basedir) : HttpService("/") {
     cout << "invalid basedir" << endl;
     exit(1);
   }
-  
+
   this->m_basedir = basedir;
+  this->m_bytes = 0;
+  pthread_mutex_init(&this->m_lock, NULL);
 }
 
 bool FileService::endswith(string str, string suffix) {
@@ -30,41 +41,177 @@ bool FileService::endswith(string str, string suffix) {
   return pos == (str.length() - suffix.length());
 }
 
-void FileService::get(HTTPRequest *request, HTTPResponse *response) {
-  string path = this->m_basedir + request->getPath();
-  string fileContents = this->readFile(path);
-  if (fileContents.size() == 0) {
-    throw ClientError::notFound();
-  } else {
-    if (this->endswith(path, ".css")) {
-      response->setContentType("text/css");
-    } else if (this->endswith(path, ".js")) {
-      response->setContentType("text/javascript");
-    }
-    response->setBody(fileContents);
+static string contentTypeOf(const string &path) {
+  static const map<string, string> types = {
+    {"css", "text/css"},
+    {"js", "text/javascript"},
+    {"json", "application/json"},
+    {"txt", "text/plain"},
+    {"svg", "image/svg+xml"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"ico", "image/x-icon"},
+    {"gz", "application/gzip"},
+  };
+  size_t dot = path.rfind('.');
+  if (dot == string::npos || path.find('/', dot) != string::npos) {
+    return "";
   }
+  map<string, string>::const_iterator iter = types.find(path.substr(dot + 1));
+  return iter == types.end() ? "" : iter->second;
+}
+
+// Whether files of contentType are worth compressing: the default, HTML,
+// and other text. Images and archives are compressed already.
+static bool compressibleType(const string &contentType) {
+  return contentType.empty() || contentType.compare(0, 5, "text/") == 0 ||
+    contentType == "application/json" || contentType == "image/svg+xml";
+}
+
+static bool sameFile(const struct stat &a, const struct stat &b) {
+  return a.st_ino == b.st_ino && a.st_dev == b.st_dev && a.st_size == b.st_size &&
+    a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+static bool newer(const struct stat &a, const struct stat &b) {
+  return a.st_mtim.tv_sec > b.st_mtim.tv_sec ||
+    (a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec > b.st_mtim.tv_nsec);
 }
 
-string FileService::readFile(string path) {
+// Opens the file at path and reads it into a StaticFile, unless it is big
+// enough to send with sendfile
+shared_ptr<StaticFile> FileService::loadFile(const string &path) {
   int fd = open(path.c_str(), O_RDONLY);
   if (fd < 0) {
-    return "";
+    return NULL;
   }
+  shared_ptr<StaticFile> file = make_shared<StaticFile>();
+  file->fd = fd;
+  if (fstat(fd, &file->st) < 0 || !S_ISREG(file->st.st_mode)) {
+    return NULL;
+  }
+
+  if ((size_t) file->st.st_size < SENDFILE_THRESHOLD) {
+    file->body.resize(file->st.st_size);
+    ssize_t bytesRead = pread(fd, &file->body[0], file->body.size(), 0);
+    if (bytesRead != (ssize_t) file->body.size()) {
+      return NULL;
+    }
+    close(fd);
+    file->fd = -1;
+  }
+
+  char etag[64];
+  snprintf(etag, sizeof(etag), "\"%lx-%lx-%lx\"", (unsigned long) file->st.st_ino,
+           (unsigned long) file->st.st_size,
+           (unsigned long) (file->st.st_mtim.tv_sec * 1000000000LL + file->st.st_mtim.tv_nsec));
+  file->etag = etag;
+  file->lastModified = HttpUtils::httpDate(file->st.st_mtim.tv_sec);
+  file->contentType = contentTypeOf(path);
+  file->compressible = compressibleType(file->contentType);
+  return file;
+}
+
+// Drops least recently used files until there's room for another
+void FileService::evict() {
+  while (!m_lru.empty() && (m_files.size() >= MAX_FILES || m_bytes > MAX_BYTES)) {
+    map<string, Entry>::iterator iter = m_files.find(m_lru.back());
+    m_bytes -= iter->second.file->body.size();
+    m_files.erase(iter);
+    m_lru.pop_back();
+  }
+}
 
-  string result;
-  int ret;
-  char buffer[4096];
-  while ((ret = read(fd, buffer, sizeof(buffer))) > 0) {
-    result.append(buffer, ret);
+shared_ptr<StaticFile> FileService::openFile(const string &path) {
+  struct stat st;
+  if (stat(path.c_str(), &st) < 0 || !S_ISREG(st.st_mode)) {
+    return NULL;
   }
 
-  close(fd);
-  
-  return result;
+  dthread_mutex_lock(&m_lock);
+  map<string, Entry>::iterator iter = m_files.find(path);
+  if (iter != m_files.end() && sameFile(iter->second.file->st, st)) {
+    m_lru.splice(m_lru.begin(), m_lru, iter->second.lru);
+    shared_ptr<StaticFile> file = iter->second.file;
+    dthread_mutex_unlock(&m_lock);
+    return file;
+  }
+  dthread_mutex_unlock(&m_lock);
+
+  // Read without the lock; another request for the same file may load it
+  // too, and the last one in wins. A changed file's old entry goes then.
+  shared_ptr<StaticFile> file = loadFile(path);
+  if (file == NULL) {
+    return NULL;
+  }
+
+  dthread_mutex_lock(&m_lock);
+  iter = m_files.find(path);
+  if (iter != m_files.end()) {
+    m_bytes -= iter->second.file->body.size();
+    m_lru.erase(iter->second.lru);
+    m_files.erase(iter);
+  }
+  evict();
+  m_lru.push_front(path);
+  m_files[path] = Entry{file, m_lru.begin()};
+  m_bytes += file->body.size();
+  dthread_mutex_unlock(&m_lock);
+  return file;
+}
+
+void FileService::serve(HTTPRequest *request, HTTPResponse *response, bool withBody) {
+  // Nothing outside basedir
+  for (const string &component : StringUtils::split(request->getPath(), '/')) {
+    if (component == "..") {
+      throw ClientError::notFound();
+    }
+  }
+
+  string path = this->m_basedir + request->getPath();
+  shared_ptr<StaticFile> file = openFile(path);
+  if (file == NULL) {
+    throw ClientError::notFound();
+  }
+  if (!file->contentType.empty()) {
+    response->setContentType(file->contentType);
+  }
+
+  // Clients that take gzip get path.gz instead, if there is one and it's
+  // no older than path
+  shared_ptr<StaticFile> gzipped = file->compressible ? openFile(path + ".gz") : NULL;
+  if (gzipped != NULL && !newer(file->st, gzipped->st)) {
+    response->setHeader("Vary", "Accept-Encoding");
+    if (request->acceptsEncoding("gzip")) {
+      response->setContentEncoding("gzip");
+      file = gzipped;
+    }
+  }
+
+  response->setHeader("ETag", file->etag);
+  response->setHeader("Last-Modified", file->lastModified);
+  string_view tags;
+  if (request->findHeader("If-None-Match", &tags) &&
+      (tags == "*" || tags.find(file->etag) != string_view::npos)) {
+    response->setStatus(304);
+    return;
+  }
+
+  if (!withBody) {
+    response->setHeader("Content-Length", to_string(file->st.st_size));
+  } else if (file->fd >= 0) {
+    response->setBodyFile(file->fd, 0, file->st.st_size, file);
+  } else {
+    response->setBody(file->body);
+  }
+}
+
+void FileService::get(HTTPRequest *request, HTTPResponse *response) {
+  serve(request, response, true);
 }
 
 void FileService::head(HTTPRequest *request, HTTPResponse *response) {
   // HEAD is the same as get but with no body
-  this->get(request, response);
-  response->setBody("");
+  serve(request, response, false);
 }
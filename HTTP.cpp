@@ -1,13 +1,26 @@
 #include "HTTP.h"
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 
 #include <assert.h>
 #include <stdio.h>
+#include <strings.h>
 
 using namespace std;
 
+#define MAX_BODY_RESERVE (64 * 1024 * 1024)
+
+// Indexed by HTTP::CommonHeader
+static const string_view commonHeaderNames[HTTP::NUM_COMMON_HEADERS] = {
+    "Content-Length", "Host", "If-None-Match", "Range", "Accept-Encoding"
+};
+
+static bool equalsIgnoreCase(string_view a, string_view b)
+{
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
 
 /***************************** HTTP Parser callbacks ************************/
 
@@ -81,6 +94,12 @@ int HTTP::headers_complete_cb(http_parser *parser)
     http->addHeaderField();
     http->m_headerDone = true;
 
+    // Size the body once up front rather than growing it as it arrives.
+    // The length is the client's word, so don't take it past a bound.
+    if((http->m_httpType == HTTP_REQUEST) && (parser->content_length > 0)) {
+        http->m_body.reserve(min(parser->content_length, (int64_t) MAX_BODY_RESERVE));
+    }
+
     if(http->m_httpType == HTTP_RESPONSE) {
         char buf[64];
         snprintf(buf, 63, "HTTP/%u.%u %u ", parser->http_major, parser->http_minor, parser->status_code);
@@ -162,25 +181,18 @@ HTTP::HTTP(http_parser_type httpType)
 
     m_parser.data = this;
 
-    m_field = NULL;
-    m_value = NULL;
+    // Enough for the headers of a typical request in one allocation each
+    m_arena.reserve(1024);
+    m_headers.reserve(16);
+    m_inHeader = false;
+    for(int idx = 0; idx < NUM_COMMON_HEADERS; idx++) {
+        m_common[idx] = -1;
+    }
     m_extraParsedBytes = 0;
 }
 
 HTTP::~HTTP()
 {
-    if(m_field != NULL) {
-        delete m_field;
-    }
-
-    if(m_value != NULL) {
-        delete m_value;
-    }
-
-    for(unsigned int idx = 0; idx < m_headers.size(); idx++) {
-        delete m_headers[idx].first;
-        delete m_headers[idx].second;
-    }
 }
 
 int HTTP::addData(const unsigned char *data, int len)
@@ -209,9 +221,46 @@ string HTTP::getPath()
     return m_path;
 }
 
+bool HTTP::findHeader(string_view name, string_view *value) const
+{
+    int common = commonHeader(name);
+    if(common >= 0) {
+        return findHeader((CommonHeader) common, value);
+    }
+
+    for(unsigned int idx = 0; idx < m_headers.size(); idx++) {
+        if(equalsIgnoreCase(headerField(idx), name)) {
+            *value = headerValue(idx);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool HTTP::findHeader(CommonHeader header, string_view *value) const
+{
+    if(m_common[header] < 0) {
+        return false;
+    }
+    *value = headerValue(m_common[header]);
+    return true;
+}
+
+string_view HTTP::headerField(int idx) const
+{
+    return string_view(m_arena).substr(m_headers[idx].field, m_headers[idx].fieldLen);
+}
+
+string_view HTTP::headerValue(int idx) const
+{
+    return string_view(m_arena).substr(m_headers[idx].value, m_headers[idx].valueLen);
+}
+
 string HTTP::getHost()
 {
-    string host = (m_method == HTTP_CONNECT) ? m_url : m_host;
+    string_view hostHeader;
+    string host = (m_method == HTTP_CONNECT) ? m_url :
+        findHeader(HOST, &hostHeader) ? string(hostHeader) : string();
     if(host.find(':') == string::npos) {
         host += ":80";
     }
@@ -239,8 +288,8 @@ string HTTP::getReplyHeader()
 
     bool foundConn = false;
     for(unsigned int idx = 0; idx < m_headers.size(); idx++) {
-        string field = *(m_headers[idx].first);
-        string value = *(m_headers[idx].second);
+        string field(headerField(idx));
+        string value(headerValue(idx));
 
         if(field == "Connection") {
             value = "close";
@@ -298,8 +347,8 @@ string HTTP::getProxyRequest(const char *userAgent)
     }
 
     for(unsigned int idx = 0; idx < m_headers.size(); idx++) {
-        string field = *(m_headers[idx].first);
-        string value = *(m_headers[idx].second);
+        string field(headerField(idx));
+        string value(headerValue(idx));
 
         if((userAgent != NULL) && (field == "User-Agent")) {
             value = string(userAgent);
@@ -350,39 +399,62 @@ void HTTP::appendUrl(const char *at, size_t len)
     m_url.append(at, len);
 }
 
-void HTTP::addHeaderField()
+int HTTP::commonHeader(string_view name)
 {
-    if(m_field != NULL) {
-        assert(m_value != NULL);
-        if(*m_field == "Host") {
-            m_host = *m_value;
+    for(int idx = 0; idx < NUM_COMMON_HEADERS; idx++) {
+        if(equalsIgnoreCase(name, commonHeaderNames[idx])) {
+            return idx;
         }
-        if(*m_field == "Eoh") {
+    }
+    return -1;
+}
+
+void HTTP::addHeaderField()
+{
+    if(m_inHeader) {
+        int idx = m_headers.size() - 1;
+        string_view field = headerField(idx);
+        if(field == "Eoh") {
             cout << "got the Eoh header" << endl;
         }
-        m_headers.insert(m_headers.end(), pair<string *, string *>(m_field, m_value));
-        m_field = NULL;
-        m_value = NULL;
-    } else {
-        assert(m_value == NULL);
+        // The first of repeated headers wins, as it does for findHeader
+        int common = commonHeader(field);
+        if(common >= 0 && m_common[common] < 0) {
+            m_common[common] = idx;
+        }
+        m_inHeader = false;
     }
 }
 
 void HTTP::newHeaderField(const char *at, size_t len)
 {
     addHeaderField();
-    m_field = new string(at, len);
-    m_value = new string();
+    Header header;
+    header.field = m_arena.size();
+    header.fieldLen = 0;
+    header.value = header.field;
+    header.valueLen = 0;
+    m_headers.push_back(header);
+    m_inHeader = true;
+    appendHeaderField(at, len);
 }
+
+// The parser hands over all of a field before any of its value, so the
+// value starts where the field ends
 void HTTP::appendHeaderField(const char *at, size_t len)
 {
-    assert(m_field != NULL);
-    m_field->append(at, len);
+    assert(m_inHeader);
+    Header &header = m_headers.back();
+    m_arena.append(at, len);
+    header.fieldLen += len;
+    header.value = header.field + header.fieldLen;
 }
 
 void HTTP::appendHeaderValue(const char *at, size_t len)
 {
-    m_value->append(at, len);
+    assert(m_inHeader);
+    m_arena.append(at, len);
+    m_headers.back().valueLen += len;
 }
 
 void HTTP::messageComplete(unsigned char method)
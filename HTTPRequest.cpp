@@ -5,26 +5,36 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <strings.h>
 
 #include "HttpUtils.h"
+#include "Trace.h"
 #include "StringUtils.h"
 
 using namespace std;
 
 #define CONNECT_REPLY "HTTP/1.1 200 Connection Established\r\n\r\n"
 
-HTTPRequest::HTTPRequest(MySocket *sock, int serverPort)
+HTTPRequest::HTTPRequest(MySocket *sock, int serverPort, SocketBuffer *buffer)
 {
     m_sock = sock;
+    m_ownsBuffer = buffer == NULL;
+    m_buffer = m_ownsBuffer ? new SocketBuffer() : buffer;
     m_http = new HTTP();
     m_serverPort = serverPort;
     m_totalBytesRead = 0;
     m_totalBytesWritten = 0;
+    m_socketReadMicros = 0;
+    m_parseMicros = 0;
 }
 
 HTTPRequest::~HTTPRequest()
 {
     delete m_http;
+    if(m_ownsBuffer) {
+        delete m_buffer;
+    }
 }
 
 void HTTPRequest::printDebugInfo()
@@ -48,34 +58,60 @@ string HTTPRequest::getPath() {
   return m_http->getPath();
 }
 
+bool HTTPRequest::findHeader(string_view key, string_view *value) {
+  // Header names are case-insensitive
+  return m_http->findHeader(key, value);
+}
+
 string HTTPRequest::getHeader(string key) {
-  vector<pair<string *, string *> >::iterator iter;
-  vector<pair<string *, string *> > headers = m_http->getHeaders();
-  for (iter = headers.begin(); iter != headers.end(); iter++) {
-    string header_key = *(iter->first);
-    if (header_key == key) {
-      return *(iter->second);
-    }
+  string_view value;
+  if (!findHeader(key, &value)) {
+    throw "could not find header";
   }
+  return string(value);
+}
 
-  throw "could not find header";
+bool HTTPRequest::hasHeader(string_view key) {
+  string_view value;
+  return findHeader(key, &value);
 }
 
-bool HTTPRequest::hasAuthToken() {
-  try {
-    getHeader("x-auth-token");
-    return true;
-  } catch (...) {
+bool HTTPRequest::acceptsEncoding(string_view coding) {
+  string_view value;
+  if (!findHeader("Accept-Encoding", &value)) {
     return false;
   }
+
+  double codingQ = -1, anyQ = -1;
+  for (const string &item : StringUtils::split(string(value), ',')) {
+    size_t semicolon = item.find(';');
+    size_t start = item.find_first_not_of(" \t");
+    size_t end = item.find_last_not_of(" \t", semicolon == string::npos ? string::npos : semicolon - 1);
+    if (start == string::npos || end == string::npos || end < start) {
+      continue;
+    }
+    string name = item.substr(start, end - start + 1);
+    double q = 1;
+    size_t qAt = semicolon == string::npos ? string::npos : item.find("q=", semicolon);
+    if (qAt != string::npos) {
+      q = strtod(item.c_str() + qAt + 2, NULL);
+    }
+    if (name.size() == coding.size() && strncasecmp(name.c_str(), coding.data(), name.size()) == 0) {
+      codingQ = q;
+    } else if (name == "*") {
+      anyQ = q;
+    }
+  }
+  return (codingQ >= 0 ? codingQ : anyQ) > 0;
+}
+
+bool HTTPRequest::hasAuthToken() {
+  return hasHeader("x-auth-token");
 }
 
 string HTTPRequest::getAuthToken() {
-  try {
-    return getHeader("x-auth-token");
-  } catch (...) {
-    return "";
-  }
+  string_view value;
+  return findHeader("x-auth-token", &value) ? string(value) : "";
 }
 
 vector<string> HTTPRequest::getPathComponents() {
@@ -86,10 +122,19 @@ bool HTTPRequest::readRequest()
 {
     assert(!m_http->isDone());
 
-    string readData;
+    // The parser works on the bytes where they landed in the buffer
     while(!m_http->isDone()) {
-        readData = m_sock->read();
-	onRead(readData.c_str(), readData.size());
+        long long start = Trace::now();
+        if(m_buffer->size() == 0) {
+            m_buffer->fill(m_sock);
+        }
+        long long filled = Trace::now();
+        size_t len;
+        const char *data = m_buffer->data(&len);
+        onRead(data, len);
+        m_buffer->consume(len);
+        m_socketReadMicros += filled - start;
+        m_parseMicros += Trace::now() - filled;
     }
 
     return true;
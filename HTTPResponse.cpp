@@ -1,13 +1,19 @@
-#include <sstream>
-
 #include "HTTPResponse.h"
 
+#include <unistd.h>
+
 using namespace std;
 
 HTTPResponse::HTTPResponse() {
   this->streaming = false;
+  this->lengthKnown = true;
+  this->bodyFd = -1;
+  this->bodyOffset = 0;
+  this->bodyLength = 0;
   this->contentType = "text/html; charset=ISO-8859-1";
   this->headers["Server"] = "Gunrock Web";
+  // gunrock_web serves one request per connection
+  this->headers["Connection"] = "close";
   this->status = 200;
 }
 
@@ -15,12 +21,26 @@ void HTTPResponse::withStreaming() {
   this->streaming = true;
 }
 
+void HTTPResponse::withoutLength() {
+  this->lengthKnown = false;
+}
+
 void HTTPResponse::setHeader(string name, string value) {
   this->headers[name] = value;
 }
 
 void HTTPResponse::setBody(string data) {
-  body = data;
+  body.swap(data);
+  bodyFd = -1;
+  bodyOwner.reset();
+}
+
+void HTTPResponse::setBodyFile(int fd, off_t offset, size_t length, shared_ptr<void> owner) {
+  body.clear();
+  bodyFd = fd;
+  bodyOffset = offset;
+  bodyLength = length;
+  bodyOwner = owner;
 }
 
 int HTTPResponse::getStatus() {
@@ -31,38 +51,89 @@ void HTTPResponse::setContentType(string contentType) {
   this->contentType = contentType;
 }
 
+void HTTPResponse::setContentEncoding(string coding) {
+  this->headers["Content-Encoding"] = coding;
+  this->headers["Vary"] = "Accept-Encoding";
+}
+
 void HTTPResponse::setStatus(int status) {
   this->status = status;
 }
 
 string HTTPResponse::statusToString() {
-  if (status == 200) {
-    return "OK";
-  } else {
-    return "Unknown";
+  switch (status) {
+  case 200: return "OK";
+  case 304: return "Not Modified";
+  case 400: return "Bad Request";
+  case 401: return "Unauthorized";
+  case 403: return "Forbidden";
+  case 404: return "Not Found";
+  case 405: return "Method Not Allowed";
+  case 409: return "Conflict";
+  case 412: return "Precondition Failed";
+  case 500: return "Internal Server Error";
+  case 501: return "Not Implemented";
+  case 507: return "Insufficient Storage";
+  default: return "Unknown";
   }
 }
 
-string HTTPResponse::response() {
-  stringstream out;
+void HTTPResponse::formatHead(string &out) {
   setHeader("Content-Type", contentType);
   if (streaming) {
     setHeader("Transfer-Encoding", "chunked");
-  } else {
-    stringstream len;
-    len << body.size();
-    setHeader("Content-Length", len.str());
+  } else if (status != 304 && lengthKnown && headers.count("Content-Length") == 0) {
+    // a 304 has no body and its length would be that of the 200; a HEAD
+    // response sets the length of the body it leaves out
+    setHeader("Content-Length", to_string(bodyFd >= 0 ? bodyLength : body.size()));
   }
 
-  out << "HTTP/1.1 " << status << " " << statusToString() << "\r\n";
+  out += "HTTP/1.1 ";
+  out += to_string(status);
+  out += " ";
+  out += statusToString();
+  out += "\r\n";
   map<string, string>::iterator iter;
   for(iter = headers.begin(); iter != headers.end(); iter++) {
-    out << iter->first << ": " << iter->second << "\r\n";
+    out += iter->first;
+    out += ": ";
+    out += iter->second;
+    out += "\r\n";
   }
-  out << "\r\n";
+  out += "\r\n";
+}
+
+string HTTPResponse::response() {
+  string out;
+  formatHead(out);
   if (body.size() > 0 && !streaming) {
-    out << body;
+    out += body;
+  }
+  if (bodyFd >= 0 && !streaming) {
+    size_t start = out.size();
+    out.resize(start + bodyLength);
+    ssize_t ret = pread(bodyFd, &out[start], bodyLength, bodyOffset);
+    out.resize(start + (ret > 0 ? ret : 0));
   }
 
-  return out.str();
+  return out;
+}
+
+size_t HTTPResponse::send(MySocket *socket) {
+  // Keeps its capacity from one response to the next
+  static thread_local string head;
+  head.clear();
+  formatHead(head);
+
+  struct iovec iov[2];
+  iov[0].iov_base = (void *) head.data();
+  iov[0].iov_len = head.size();
+  iov[1].iov_base = (void *) body.data();
+  iov[1].iov_len = streaming ? 0 : body.size();
+  socket->writev(iov, 2);
+  if (bodyFd >= 0 && !streaming) {
+    socket->sendfile(bodyFd, bodyOffset, bodyLength);
+    return iov[0].iov_len + bodyLength;
+  }
+  return iov[0].iov_len + iov[1].iov_len;
 }
@@ -1,5 +1,3 @@
-#include <iostream>
-
 #include <stdlib.h>
 #include <stdio.h>
 
@@ -17,32 +15,26 @@ string HttpService::pathPrefix() {
 }
 
 void HttpService::head(HTTPRequest *request, HTTPResponse *response) {
-  cout << "HEAD " << request->getPath() << endl;
   throw ClientError::methodNotAllowed();
 }
 
 void HttpService::get(HTTPRequest *request, HTTPResponse *response) {
-  cout << "GET " << request->getPath() << endl;
   throw ClientError::methodNotAllowed();
 }
 
 void HttpService::put(HTTPRequest *request, HTTPResponse *response) {
-  cout << "PUT " << request->getPath() << endl;
   throw ClientError::methodNotAllowed();
 }
 
 void HttpService::post(HTTPRequest *request, HTTPResponse *response) {
-  cout << "POST " << request->getPath() << endl;
   throw ClientError::methodNotAllowed();
 }
 
 void HttpService::del(HTTPRequest *request, HTTPResponse *response) {
-  cout << "DELETE " << request->getPath() << endl;
   throw ClientError::methodNotAllowed();
 }
 
 void HttpService::move(HTTPRequest *request, HTTPResponse *response) {
-  cout << "MOVE " << request->getPath() << endl;
   throw ClientError::methodNotAllowed();
 }
 
@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <time.h>
 
 #include "HttpUtils.h"
 
@@ -15,6 +16,9 @@ map<string, string> HttpUtils::params(string query) {
   for (unsigned idx = 0; idx < pairs.size(); idx++) {
     string param = pairs[idx];
     vector<string> elements = split(param, '=');
+    if (elements.size() == 1 && param.find('=') == string::npos) {
+      elements.push_back("");  // a bare flag like ?append
+    }
     if (elements.size() != 2) {
       throw MalformedQueryString(query);
     }
@@ -69,3 +73,12 @@ vector<string> HttpUtils::split(const string &s, char delim) {
   }
   return result;
 }
+
+string HttpUtils::httpDate(long long seconds) {
+  time_t t = (time_t) seconds;
+  struct tm tm;
+  char date[64];
+  gmtime_r(&t, &tm);
+  strftime(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+  return date;
+}
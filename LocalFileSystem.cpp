@@ -5,8 +5,14 @@
 #include <cstring>
 #include <climits>
 #include <algorithm>
+#include <unordered_map>
+#include <set>
+#include <ctime>
 
 #include "LocalFileSystem.h"
+#include "Crc32c.h"
+#include "Lz4.h"
+#include "Trace.h"
 #include "ufs.h"
 
 
@@ -15,6 +21,8 @@ using namespace std;
 
 LocalFileSystem::LocalFileSystem(Disk *disk) {
   this->disk = disk;
+  this->fingerprintsLoaded = false;
+  this->fingerprintsGeneration = 0;
 }
 
 
@@ -42,6 +50,7 @@ void LocalFileSystem::readInodeBitmap(super_t *super, unsigned char *inodeBitmap
 
 
 void LocalFileSystem::writeInodeBitmap(super_t *super, unsigned char *inodeBitmap) {
+    TraceSpan span("write inode bitmap");
     int bitmapSize = (super->num_inodes + 7) / 8;  // Size of bitmap in bytes
     unsigned char *tempBitmap = new unsigned char[super->inode_bitmap_len * UFS_BLOCK_SIZE]();
     
@@ -79,6 +88,7 @@ void LocalFileSystem::readDataBitmap(super_t *super, unsigned char *dataBitmap)
 
 
 void LocalFileSystem::writeDataBitmap(super_t *super, unsigned char *dataBitmap) {
+    TraceSpan span("write data bitmap");
     int bitmapSize = (super->num_data + 7) / 8;  // Size of bitmap in bytes
     unsigned char *tempBitmap = new unsigned char[super->data_bitmap_len * UFS_BLOCK_SIZE]();
 
@@ -115,6 +125,7 @@ void LocalFileSystem::readInodeRegion(super_t *super, inode_t *inodes) {
 
 
 void LocalFileSystem::writeInodeRegion(super_t *super, inode_t *inodes) {
+    TraceSpan span("write inodes");
     int regionSize = super->num_inodes * sizeof(inode_t);  // Total size in bytes
     unsigned char *tempRegion = new unsigned char[super->inode_region_len * UFS_BLOCK_SIZE]();
 
@@ -138,51 +149,803 @@ void LocalFileSystem::writeInodeRegion(super_t *super, inode_t *inodes) {
 
 
 
-int LocalFileSystem::lookup(int parentInodeNumber, std::string name) {
+int LocalFileSystem::readInodeExt(super_t *super, int inodeNumber, inode_ext_t *ext) {
+    memset(ext, 0, sizeof(inode_ext_t));
+    if (super->inode_ext_len == 0) {
+        return 0;  // nothing beyond inode_t on this image
+    }
+    if (inodeNumber < 0 || inodeNumber >= super->num_inodes) {
+        return -EINVALIDINODE;
+    }
+
+    int offset = inodeNumber * sizeof(inode_ext_t);
+    unsigned char buffer[UFS_BLOCK_SIZE];
+    disk->readBlock(super->inode_ext_addr + offset / UFS_BLOCK_SIZE, buffer);
+    memcpy(ext, buffer + offset % UFS_BLOCK_SIZE, sizeof(inode_ext_t));
+    return 0;
+}
+
+
+void LocalFileSystem::writeInodeExt(super_t *super, int inodeNumber, inode_ext_t *ext) {
+    // One inode_ext_t never straddles a block, so this is a single block
+    // update rather than a rewrite of the region
+    int offset = inodeNumber * sizeof(inode_ext_t);
+    unsigned char buffer[UFS_BLOCK_SIZE];
+    disk->readBlock(super->inode_ext_addr + offset / UFS_BLOCK_SIZE, buffer);
+    if (memcmp(buffer + offset % UFS_BLOCK_SIZE, ext, sizeof(inode_ext_t)) != 0) {
+        memcpy(buffer + offset % UFS_BLOCK_SIZE, ext, sizeof(inode_ext_t));
+        disk->writeBlock(super->inode_ext_addr + offset / UFS_BLOCK_SIZE, buffer);
+    }
+}
+
+
+// Marks new contents in an inode_ext_t on images that keep versions
+static void bumpVersion(super_t *super, inode_ext_t *ext) {
+    if (super->features & UFS_FEATURE_VERSIONS) {
+        ext->version++;
+        ext->mtime = time(NULL);
+    }
+}
+
+
+int LocalFileSystem::getVersion(int inodeNumber, unsigned long long *version, long long *mtime) {
     super_t super;
     readSuperBlock(&super);
 
-    // Validate the parent inode number
-    if (parentInodeNumber < 0 || parentInodeNumber >= super.num_inodes) {
+    inode_ext_t ext;
+    if (readInodeExt(&super, inodeNumber, &ext) < 0) {
         return -EINVALIDINODE;
     }
+    *version = ext.version;
+    *mtime = ext.mtime;
+    return 0;
+}
 
-    inode_t parentInode;
-    if (stat(parentInodeNumber, &parentInode) < 0) {
-        return -EINVALIDINODE;
+
+// Compresses data block by block into packed, filling in clen[]. Returns
+// false when that wouldn't save a single data block, and the file is better
+// stored as is.
+static bool compressBlocks(const char *data, int size, std::vector<char> &packed, unsigned short *clen) {
+    int numBlocks = (size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    packed.resize(size);
+
+    int packedSize = 0;
+    for (int i = 0; i < numBlocks; i++) {
+        int offset = i * UFS_BLOCK_SIZE;
+        int length = std::min(UFS_BLOCK_SIZE, size - offset);
+        int room = std::min(length - 1, size - packedSize);
+
+        int compressed = room > 0 ? Lz4::compress((const uint8_t *) data + offset, length,
+                                                  (uint8_t *) &packed[packedSize], room) : 0;
+        if (compressed == 0) {
+            if (packedSize + length > size) {
+                return false;
+            }
+            memcpy(&packed[packedSize], data + offset, length);  // stored as is
+            compressed = length;
+        }
+        clen[i] = compressed;
+        packedSize += compressed;
     }
 
-    // Ensure the parent inode is a directory
-    if (parentInode.type != UFS_DIRECTORY) {
+    packed.resize(packedSize);
+    return (packedSize + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE < numBlocks;
+}
+
+
+// The refcount array covers the whole region, refcount_len blocks of
+// UFS_REFCOUNTS_PER_BLOCK counts, so it is read and written as is.
+void LocalFileSystem::readRefcounts(super_t *super, unsigned int *refcounts) {
+    for (int i = 0; i < super->refcount_len; i++) {
+        disk->readBlock(super->refcount_addr + i, refcounts + i * UFS_REFCOUNTS_PER_BLOCK);
+    }
+}
+
+
+void LocalFileSystem::writeRefcounts(super_t *super, unsigned int *refcounts) {
+    for (int i = 0; i < super->refcount_len; i++) {
+        disk->writeBlock(super->refcount_addr + i, refcounts + i * UFS_REFCOUNTS_PER_BLOCK);
+    }
+}
+
+
+void LocalFileSystem::readFingerprints(super_t *super, unsigned long long *fingerprints) {
+    for (int i = 0; i < super->fingerprint_len; i++) {
+        disk->readBlock(super->fingerprint_addr + i, fingerprints + i * UFS_FINGERPRINTS_PER_BLOCK);
+    }
+}
+
+
+void LocalFileSystem::writeFingerprints(super_t *super, unsigned long long *fingerprints) {
+    for (int i = 0; i < super->fingerprint_len; i++) {
+        disk->writeBlock(super->fingerprint_addr + i, fingerprints + i * UFS_FINGERPRINTS_PER_BLOCK);
+    }
+}
+
+
+void LocalFileSystem::readChecksums(super_t *super, unsigned int *checksums) {
+    for (int i = 0; i < super->checksum_len; i++) {
+        disk->readBlock(super->checksum_addr + i, checksums + i * UFS_CHECKSUMS_PER_BLOCK);
+    }
+}
+
+
+void LocalFileSystem::writeChecksums(super_t *super, unsigned int *checksums) {
+    for (int i = 0; i < super->checksum_len; i++) {
+        disk->writeBlock(super->checksum_addr + i, checksums + i * UFS_CHECKSUMS_PER_BLOCK);
+    }
+}
+
+
+unsigned int *LocalFileSystem::loadChecksums(super_t *super) {
+    if (!(super->features & UFS_FEATURE_CHECKSUMS)) {
+        return NULL;
+    }
+
+    unsigned int *checksums = new unsigned int[super->checksum_len * UFS_CHECKSUMS_PER_BLOCK];
+    readChecksums(super, checksums);
+    return checksums;
+}
+
+
+// The checksum region entry for a block's contents; 0 is kept for "none"
+static unsigned int blockChecksum(const void *block) {
+    unsigned int crc = Crc32c::compute(block, UFS_BLOCK_SIZE);
+    return crc != 0 ? crc : 1;
+}
+
+
+// Records the checksum of what a data block now holds. Returns true if the
+// region entry changed.
+static bool recordChecksum(super_t *super, unsigned int *checksums, unsigned int blockNum, const void *block) {
+    if (checksums == NULL) {
+        return false;
+    }
+    unsigned int checksum = blockChecksum(block);
+    unsigned int &entry = checksums[blockNum - super->data_region_addr];
+    if (entry == checksum) {
+        return false;
+    }
+    entry = checksum;
+    return true;
+}
+
+
+int LocalFileSystem::readFileBlock(super_t *super, unsigned int *checksums, unsigned int blockNum, void *block) {
+    disk->readBlock(blockNum, block);
+    if (checksums != NULL && blockNum >= static_cast<unsigned int>(super->data_region_addr) &&
+        blockNum < static_cast<unsigned int>(super->data_region_addr + super->data_region_len)) {
+        unsigned int expected = checksums[blockNum - super->data_region_addr];
+        if (expected != 0 && expected != blockChecksum(block)) {
+            return -ECORRUPT;
+        }
+    }
+    return 0;
+}
+
+
+unsigned int *LocalFileSystem::loadRefcounts(super_t *super) {
+    if (!(super->features & UFS_FEATURE_SHARED_BLOCKS)) {
+        return NULL;
+    }
+
+    unsigned int *refcounts = new unsigned int[super->refcount_len * UFS_REFCOUNTS_PER_BLOCK];
+    readRefcounts(super, refcounts);
+    return refcounts;
+}
+
+// The data blocks not in use in dataBitmap
+static int countFreeBlocks(super_t *super, unsigned char *dataBitmap) {
+    int freeBlocks = 0;
+    for (int i = 0; i < super->num_data; i++) {
+        if (!(dataBitmap[i / 8] & (1 << (i % 8)))) {
+            freeBlocks++;
+        }
+    }
+    return freeBlocks;
+}
+
+bool LocalFileSystem::releaseDataBlock(super_t *super, unsigned char *dataBitmap, unsigned int *refcounts,
+                                       unsigned int blockNum) {
+    int dataBlockIndex = blockNum - super->data_region_addr;
+    if (refcounts != NULL && refcounts[dataBlockIndex] > 0) {
+        refcounts[dataBlockIndex]--;  // another file still uses it
+        return true;
+    }
+
+    dataBitmap[dataBlockIndex / 8] &= ~(1 << (dataBlockIndex % 8));
+    if (fingerprintsLoaded) {
+        forgetFingerprint(super, blockNum);
+    }
+    return false;
+}
+
+
+
+
+// XXH64 with seed 0 over one data block, the fingerprint of a block on dedup
+// images. Four independent lanes keep the multiplies pipelined; a block is a
+// whole number of 32 byte stripes, so there is no tail to mix in. 0 means "no
+// fingerprint" on disk and is never returned.
+static_assert(UFS_BLOCK_SIZE % 32 == 0, "blocks must be whole XXH64 stripes");
+
+static const unsigned long long XXH_PRIME64_1 = 0x9E3779B185EBCA87ULL;
+static const unsigned long long XXH_PRIME64_2 = 0xC2B2AE3D27D4EB4FULL;
+static const unsigned long long XXH_PRIME64_3 = 0x165667B19E3779F9ULL;
+static const unsigned long long XXH_PRIME64_4 = 0x85EBCA77C2B2AE63ULL;
+
+static inline unsigned long long xxhRotl(unsigned long long x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static inline unsigned long long xxhRound(unsigned long long acc, unsigned long long input) {
+    acc += input * XXH_PRIME64_2;
+    acc = xxhRotl(acc, 31);
+    return acc * XXH_PRIME64_1;
+}
+
+static inline unsigned long long xxhMergeRound(unsigned long long acc, unsigned long long val) {
+    acc ^= xxhRound(0, val);
+    return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+static unsigned long long blockFingerprint(const void *block) {
+    const unsigned char *p = static_cast<const unsigned char *>(block);
+    unsigned long long v1 = XXH_PRIME64_1 + XXH_PRIME64_2;
+    unsigned long long v2 = XXH_PRIME64_2;
+    unsigned long long v3 = 0;
+    unsigned long long v4 = 0 - XXH_PRIME64_1;
+
+    for (int offset = 0; offset < UFS_BLOCK_SIZE; offset += 32) {
+        unsigned long long lanes[4];
+        memcpy(lanes, p + offset, sizeof(lanes));
+        v1 = xxhRound(v1, lanes[0]);
+        v2 = xxhRound(v2, lanes[1]);
+        v3 = xxhRound(v3, lanes[2]);
+        v4 = xxhRound(v4, lanes[3]);
+    }
+
+    unsigned long long h = xxhRotl(v1, 1) + xxhRotl(v2, 7) + xxhRotl(v3, 12) + xxhRotl(v4, 18);
+    h = xxhMergeRound(h, v1);
+    h = xxhMergeRound(h, v2);
+    h = xxhMergeRound(h, v3);
+    h = xxhMergeRound(h, v4);
+    h += UFS_BLOCK_SIZE;
+
+    h ^= h >> 33;
+    h *= XXH_PRIME64_2;
+    h ^= h >> 29;
+    h *= XXH_PRIME64_3;
+    h ^= h >> 32;
+    return h != 0 ? h : 1;
+}
+
+void LocalFileSystem::indexFileBlocks(super_t *super, unsigned char *dataBitmap, unsigned long long *fingerprints,
+                                      std::unordered_map<unsigned long long, unsigned int> &index) {
+    unsigned char *inodeBitmap = new unsigned char[(super->num_inodes + 7) / 8];
+    readInodeBitmap(super, inodeBitmap);
+    inode_t *inodes = new inode_t[super->num_inodes];
+    readInodeRegion(super, inodes);
+
+    // Only blocks that a file still points at are candidates. Directory
+    // blocks and freed blocks may carry an old fingerprint but never match.
+    for (int i = 0; i < super->num_inodes; i++) {
+        inode_t *inode = &inodes[i];
+        if (!(inodeBitmap[i / 8] & (1 << (i % 8))) || inode->type != UFS_REGULAR_FILE ||
+            inode->size < 0 || inode->size > MAX_FILE_SIZE || UFS_HAS_INLINE_DATA(super, inode)) {
+            continue;
+        }
+
+        int numBlocks = (inode->size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+        for (int j = 0; j < numBlocks; j++) {
+            int dataBlockIndex = (int) inode->direct[j] - super->data_region_addr;
+            if (dataBlockIndex >= 0 && dataBlockIndex < super->num_data &&
+                (dataBitmap[dataBlockIndex / 8] & (1 << (dataBlockIndex % 8))) &&
+                fingerprints[dataBlockIndex] != 0) {
+                index.emplace(fingerprints[dataBlockIndex], inode->direct[j]);
+            }
+        }
+    }
+
+    delete[] inodeBitmap;
+    delete[] inodes;
+}
+
+void LocalFileSystem::loadFingerprintIndex(super_t *super, unsigned char *dataBitmap) {
+    if (fingerprintsLoaded && fingerprintsGeneration == disk->generation()) {
+        return;
+    }
+    fingerprints.assign(super->fingerprint_len * UFS_FINGERPRINTS_PER_BLOCK, 0);
+    readFingerprints(super, fingerprints.data());
+    fingerprintIndex.clear();
+    indexFileBlocks(super, dataBitmap, fingerprints.data(), fingerprintIndex);
+    fingerprintsLoaded = true;
+    fingerprintsGeneration = disk->generation();
+}
+
+void LocalFileSystem::forgetFingerprint(super_t *super, unsigned int blockNum) {
+    int dataBlockIndex = blockNum - super->data_region_addr;
+    std::unordered_map<unsigned long long, unsigned int>::iterator entry =
+        fingerprintIndex.find(fingerprints[dataBlockIndex]);
+    if (entry != fingerprintIndex.end() && entry->second == blockNum) {
+        fingerprintIndex.erase(entry);
+    }
+}
+
+
+
+
+int LocalFileSystem::readDirectoryEntries(inode_t *dirInode, std::vector<dir_ent_t> &entries) {
+    int numSlots = dirInode->size / sizeof(dir_ent_t);
+    int numBlocks = (dirInode->size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    int numEntriesPerBlock = UFS_BLOCK_SIZE / sizeof(dir_ent_t);
+
+    // Keep whole blocks in memory so callers can write a block back from
+    // &entries[block * numEntriesPerBlock].
+    entries.resize(numBlocks * numEntriesPerBlock);
+    for (int i = 0; i < numBlocks; i++) {
+        disk->readBlock(dirInode->direct[i], &entries[i * numEntriesPerBlock]);
+    }
+
+    // Anything past the directory size is stale data, never entries
+    for (int i = numSlots; i < (int) entries.size(); i++) {
+        entries[i].inum = -1;
+        memset(entries[i].name, 0, DIR_ENT_NAME_SIZE);
+    }
+
+    return numSlots;
+}
+
+// Helpers for long-name directories (UFS_FEATURE_LONG_NAMES), see dir_rec_t.
+
+// Decodes the in-use records of a directory block. A corrupt rec_len ends
+// the walk rather than running off the end of the block.
+static void decodeDirBlock(const unsigned char *block, std::vector<DirectoryEntry> &records) {
+    int offset = 0;
+    while (offset + (int) sizeof(dir_rec_t) <= UFS_BLOCK_SIZE) {
+        dir_rec_t rec;
+        memcpy(&rec, block + offset, sizeof(dir_rec_t));
+        if (rec.rec_len < sizeof(dir_rec_t) || offset + rec.rec_len > UFS_BLOCK_SIZE) {
+            break;
+        }
+
+        if (rec.inum != -1 && DIR_REC_LEN(rec.name_len) <= rec.rec_len) {
+            DirectoryEntry entry;
+            entry.name.assign((const char *) block + offset + sizeof(dir_rec_t), rec.name_len);
+            entry.inum = rec.inum;
+            records.push_back(entry);
+        }
+        offset += rec.rec_len;
+    }
+}
+
+// Bytes the records of a block take up when packed
+static int dirBlockBytes(const std::vector<DirectoryEntry> &records) {
+    int bytes = 0;
+    for (const DirectoryEntry &entry : records) {
+        bytes += DIR_REC_LEN(entry.name.length());
+    }
+    return bytes;
+}
+
+// Packs records at the start of a block. The last record absorbs the rest of
+// the block; a block without records is a single free record.
+static void encodeDirBlock(const std::vector<DirectoryEntry> &records, unsigned char *block) {
+    memset(block, 0, UFS_BLOCK_SIZE);
+
+    dir_rec_t rec;
+    rec.inum = -1;
+    rec.hash = 0;
+    rec.rec_len = UFS_BLOCK_SIZE;
+    rec.name_len = 0;
+    rec.pad = 0;
+    if (records.empty()) {
+        memcpy(block, &rec, sizeof(dir_rec_t));
+        return;
+    }
+
+    int offset = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        const std::string &name = records[i].name;
+        rec.inum = records[i].inum;
+        rec.hash = ufs_name_hash(name.c_str(), name.length());
+        rec.name_len = name.length();
+        rec.rec_len = (i == records.size() - 1) ? UFS_BLOCK_SIZE - offset : DIR_REC_LEN(name.length());
+
+        memcpy(block + offset, &rec, sizeof(dir_rec_t));
+        memcpy(block + offset + sizeof(dir_rec_t), name.c_str(), name.length());
+        offset += rec.rec_len;
+    }
+}
+
+int LocalFileSystem::readDirectoryRecords(inode_t *dirInode, std::vector<std::vector<DirectoryEntry> > &blocks) {
+    int numBlocks = dirInode->size / UFS_BLOCK_SIZE;
+    unsigned char block[UFS_BLOCK_SIZE];
+
+    blocks.assign(numBlocks, std::vector<DirectoryEntry>());
+    for (int i = 0; i < numBlocks; i++) {
+        disk->readBlock(dirInode->direct[i], block);
+        decodeDirBlock(block, blocks[i]);
+    }
+
+    return numBlocks;
+}
+
+int LocalFileSystem::listDirectory(super_t *super, inode_t *dirInode, std::vector<DirectoryEntry> &entries) {
+    if (super->features & UFS_FEATURE_LONG_NAMES) {
+        std::vector<std::vector<DirectoryEntry> > blocks;
+        readDirectoryRecords(dirInode, blocks);
+        for (const std::vector<DirectoryEntry> &records : blocks) {
+            entries.insert(entries.end(), records.begin(), records.end());
+        }
+    } else {
+        std::vector<dir_ent_t> slots;
+        int numSlots = readDirectoryEntries(dirInode, slots);
+        for (int i = 0; i < numSlots; i++) {
+            if (slots[i].inum != -1) {
+                DirectoryEntry entry;
+                entry.name = slots[i].name;
+                entry.inum = slots[i].inum;
+                entries.push_back(entry);
+            }
+        }
+    }
+
+    return entries.size();
+}
+
+int LocalFileSystem::readDirectory(int inodeNumber, std::vector<DirectoryEntry> &entries) {
+    inode_t inode;
+    if (stat(inodeNumber, &inode) < 0 || inode.type != UFS_DIRECTORY) {
         return -EINVALIDINODE;
     }
 
+    super_t super;
+    readSuperBlock(&super);
+    return listDirectory(&super, &inode, entries);
+}
+
+int LocalFileSystem::findDirectoryEntry(super_t *super, inode_t *dirInode, std::string name) {
+    if (super->features & UFS_FEATURE_LONG_NAMES) {
+        // Walk the records in place and compare the stored hash first, so
+        // only a real match pays for a name compare.
+        unsigned int hash = ufs_name_hash(name.c_str(), name.length());
+        int numBlocks = dirInode->size / UFS_BLOCK_SIZE;
+        unsigned char block[UFS_BLOCK_SIZE];
+
+        for (int i = 0; i < numBlocks; i++) {
+            disk->readBlock(dirInode->direct[i], block);
 
-    int numBlocks = parentInode.size / UFS_BLOCK_SIZE;
-    if (parentInode.size % UFS_BLOCK_SIZE != 0) {
-        numBlocks += 1;
+            int offset = 0;
+            while (offset + (int) sizeof(dir_rec_t) <= UFS_BLOCK_SIZE) {
+                dir_rec_t rec;
+                memcpy(&rec, block + offset, sizeof(dir_rec_t));
+                if (rec.rec_len < sizeof(dir_rec_t) || offset + rec.rec_len > UFS_BLOCK_SIZE) {
+                    break;
+                }
+                if (rec.inum != -1 && rec.hash == hash && rec.name_len == name.length() &&
+                    memcmp(block + offset + sizeof(dir_rec_t), name.c_str(), rec.name_len) == 0) {
+                    return rec.inum; // Found the entry
+                }
+                offset += rec.rec_len;
+            }
+        }
+
+        return -ENOTFOUND;
+    }
+
+    // Only the slots below the directory size hold entries, so the scan
+    // stays as short as the directory itself.
+    std::vector<dir_ent_t> entries;
+    int numSlots = readDirectoryEntries(dirInode, entries);
+    for (int i = 0; i < numSlots; i++) {
+        if (entries[i].inum != -1 && name == entries[i].name) {
+            return entries[i].inum; // Found the entry
+        }
+    }
+
+    return -ENOTFOUND;
+}
+
+int LocalFileSystem::addDirectoryEntry(super_t *super, inode_t *dirInode, unsigned char *dataBitmap,
+                                       std::string name, int inum) {
+    bool longNames = (super->features & UFS_FEATURE_LONG_NAMES) != 0;
+    int numEntriesPerBlock = UFS_BLOCK_SIZE / sizeof(dir_ent_t);
+    int numBlocks = (dirInode->size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+
+    // fixed-size dir_ent_t slots
+    std::vector<dir_ent_t> entries;
+    int numSlots = 0;
+    int slot = -1;
+
+    // long-name records, one list per directory block
+    std::vector<std::vector<DirectoryEntry> > recordBlocks;
+
+    // A hole left behind by unlink is reused before the directory is grown
+    int blockIndex = -1;
+    if (longNames) {
+        numBlocks = readDirectoryRecords(dirInode, recordBlocks);
+        int recordLength = DIR_REC_LEN(name.length());
+        for (int i = 0; i < numBlocks; i++) {
+            if (dirBlockBytes(recordBlocks[i]) + recordLength <= UFS_BLOCK_SIZE) {
+                blockIndex = i;
+                break;
+            }
+        }
+        if (blockIndex == -1) {
+            blockIndex = numBlocks;
+        }
+    } else {
+        numSlots = readDirectoryEntries(dirInode, entries);
+        slot = numSlots;
+        for (int i = 0; i < numSlots; i++) {
+            if (entries[i].inum == -1) {
+                slot = i;
+                break;
+            }
+        }
+        blockIndex = slot / numEntriesPerBlock;
     }
-    for (int i = 0; i < numBlocks; i++) {  // Iterate only over valid blocks
-        if (parentInode.direct[i] == 0 || parentInode.direct[i] == UINT_MAX) {
-            continue;  // Skip unused or invalid block pointers
+
+    if (blockIndex >= numBlocks) {
+        // The directory is full, allocate a new data block for it
+        if (numBlocks >= DIRECT_PTRS) {
+            return -ENOTENOUGHSPACE;
+        }
+
+        int newBlockIndex = -1;
+        for (int i = 0; i < super->num_data; i++) {
+            if (!(dataBitmap[i / 8] & (1 << (i % 8)))) {
+                newBlockIndex = i;
+                dataBitmap[i / 8] |= (1 << (i % 8));
+                break;
+            }
         }
+        if (newBlockIndex == -1) {
+            return -ENOTENOUGHSPACE;
+        }
+
+        dirInode->direct[blockIndex] = super->data_region_addr + newBlockIndex;
+        if (longNames) {
+            recordBlocks.resize(blockIndex + 1);
+            dirInode->size += UFS_BLOCK_SIZE;
+        } else {
+            entries.resize((blockIndex + 1) * numEntriesPerBlock);
+            for (int k = blockIndex * numEntriesPerBlock; k < (int) entries.size(); k++) {
+                entries[k].inum = -1; // Initialize entries as unused
+                memset(entries[k].name, 0, DIR_ENT_NAME_SIZE);
+            }
+        }
+    }
+
+    if (longNames) {
+        DirectoryEntry entry;
+        entry.name = name;
+        entry.inum = inum;
+        recordBlocks[blockIndex].push_back(entry);
 
         unsigned char block[UFS_BLOCK_SIZE];
-        disk->readBlock(parentInode.direct[i], block);
+        encodeDirBlock(recordBlocks[blockIndex], block);
+        disk->writeBlock(dirInode->direct[blockIndex], block);
+    } else {
+        strncpy(entries[slot].name, name.c_str(), DIR_ENT_NAME_SIZE - 1);
+        entries[slot].name[DIR_ENT_NAME_SIZE - 1] = '\0';
+        entries[slot].inum = inum;
+        disk->writeBlock(dirInode->direct[blockIndex], &entries[blockIndex * numEntriesPerBlock]);
+
+        if (slot == numSlots) {
+            dirInode->size += sizeof(dir_ent_t);
+        }
+    }
+
+    return 0;
+}
+
+int LocalFileSystem::removeDirectoryEntry(super_t *super, inode_t *dirInode, unsigned char *dataBitmap,
+                                          std::string name) {
+    bool longNames = (super->features & UFS_FEATURE_LONG_NAMES) != 0;
+    int maxEntriesPerBlock = UFS_BLOCK_SIZE / sizeof(dir_ent_t);
+    int totalBlocks = (dirInode->size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
 
-        dir_ent_t *entries = reinterpret_cast<dir_ent_t *>(block);
-        int numEntries = UFS_BLOCK_SIZE / sizeof(dir_ent_t);
+    std::vector<dir_ent_t> dirEntries;
+    int numEntries = 0;
+    std::vector<std::vector<DirectoryEntry> > recordBlocks;
 
-        for (int j = 0; j < numEntries; j++) {
-            if (entries[j].inum != 0 && name == std::string(entries[j].name)) {
-                return entries[j].inum; // Found the entry
+    // Find the entry. For fixed-size entries entryIndex is the slot; for
+    // long-name records it is the position within entryBlock.
+    int entryIndex = -1;
+    int entryBlock = -1;
+    int entryInodeNumber = -ENOTFOUND;
+    if (longNames) {
+        readDirectoryRecords(dirInode, recordBlocks);
+        for (int i = 0; i < totalBlocks && entryIndex == -1; ++i) {
+            for (int j = 0; j < (int) recordBlocks[i].size(); ++j) {
+                if (recordBlocks[i][j].name == name) {
+                    entryBlock = i;
+                    entryIndex = j;
+                    entryInodeNumber = recordBlocks[i][j].inum;
+                    break;
+                }
+            }
+        }
+    } else {
+        numEntries = readDirectoryEntries(dirInode, dirEntries);
+        for (int i = 0; i < numEntries; ++i) {
+            if (dirEntries[i].inum != -1 && std::string(dirEntries[i].name) == name) {
+                entryIndex = i;
+                entryBlock = i / maxEntriesPerBlock;
+                entryInodeNumber = dirEntries[i].inum;
+                break;
             }
         }
     }
 
+    if (entryIndex == -1) {
+        return -ENOTFOUND;
+    }
+
+    // Remove the entry and compact the directory so that entries stay
+    // packed, which keeps lookups short and lets create find room without
+    // searching.
+    int lastBlock = entryBlock;
+    int remainingBlocks = totalBlocks;
+    if (longNames) {
+        // Records are repacked within their block, and records from the last
+        // block are pulled into the space that was freed. Empty blocks at the
+        // end are returned; an empty block in the middle stays as free space.
+        recordBlocks[entryBlock].erase(recordBlocks[entryBlock].begin() + entryIndex);
+        lastBlock = totalBlocks - 1;
+        std::vector<DirectoryEntry> &tail = recordBlocks[lastBlock];
+        while (lastBlock != entryBlock && !tail.empty() &&
+               dirBlockBytes(recordBlocks[entryBlock]) + DIR_REC_LEN(tail.back().name.length()) <= UFS_BLOCK_SIZE) {
+            recordBlocks[entryBlock].push_back(tail.back());
+            tail.pop_back();
+        }
+        while (remainingBlocks > 1 && recordBlocks[remainingBlocks - 1].empty()) {
+            remainingBlocks--;
+        }
+        dirInode->size = remainingBlocks * UFS_BLOCK_SIZE;
+    } else {
+        // The last entry is moved into the freed slot
+        int lastIndex = numEntries - 1;
+        while (lastIndex > entryIndex && dirEntries[lastIndex].inum == -1) {
+            lastIndex--;
+        }
+
+        lastBlock = lastIndex / maxEntriesPerBlock;
+        if (lastIndex != entryIndex) {
+            dirEntries[entryIndex] = dirEntries[lastIndex];
+        }
+        dirEntries[lastIndex].inum = -1;  // Mark as unused
+        memset(dirEntries[lastIndex].name, 0, DIR_ENT_NAME_SIZE);
+
+        // Trim trailing free slots off the end of the directory
+        while (numEntries > 0 && dirEntries[numEntries - 1].inum == -1) {
+            numEntries--;
+        }
+        dirInode->size = numEntries * sizeof(dir_ent_t);
+        remainingBlocks = (dirInode->size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    }
+
+    // Return blocks that no longer hold any entries
+    for (int i = remainingBlocks; i < totalBlocks; ++i) {
+        unsigned int blockNum = dirInode->direct[i];
+        int dataBlockIndex = blockNum - super->data_region_addr;
+        dataBitmap[dataBlockIndex / 8] &= ~(1 << (dataBlockIndex % 8));
+        dirInode->direct[i] = 0;
+    }
+
+    // Write back only the directory blocks we touched
+    if (longNames) {
+        unsigned char block[UFS_BLOCK_SIZE];
+        if (entryBlock < remainingBlocks) {
+            encodeDirBlock(recordBlocks[entryBlock], block);
+            disk->writeBlock(dirInode->direct[entryBlock], block);
+        }
+        if (lastBlock != entryBlock && lastBlock < remainingBlocks) {
+            encodeDirBlock(recordBlocks[lastBlock], block);
+            disk->writeBlock(dirInode->direct[lastBlock], block);
+        }
+    } else {
+        if (entryBlock < remainingBlocks) {
+            disk->writeBlock(dirInode->direct[entryBlock], &dirEntries[entryBlock * maxEntriesPerBlock]);
+        }
+        if (lastBlock != entryBlock && lastBlock < remainingBlocks) {
+            disk->writeBlock(dirInode->direct[lastBlock], &dirEntries[lastBlock * maxEntriesPerBlock]);
+        }
+    }
+
+    return entryInodeNumber;
+}
+
+int LocalFileSystem::replaceDirectoryEntry(super_t *super, inode_t *dirInode, std::string name, int inum) {
+    if (super->features & UFS_FEATURE_LONG_NAMES) {
+        std::vector<std::vector<DirectoryEntry> > recordBlocks;
+        int numBlocks = readDirectoryRecords(dirInode, recordBlocks);
+        for (int i = 0; i < numBlocks; i++) {
+            for (DirectoryEntry &entry : recordBlocks[i]) {
+                if (entry.name == name) {
+                    entry.inum = inum;
+
+                    unsigned char block[UFS_BLOCK_SIZE];
+                    encodeDirBlock(recordBlocks[i], block);
+                    disk->writeBlock(dirInode->direct[i], block);
+                    return 0;
+                }
+            }
+        }
+        return -ENOTFOUND;
+    }
+
+    int numEntriesPerBlock = UFS_BLOCK_SIZE / sizeof(dir_ent_t);
+    std::vector<dir_ent_t> entries;
+    int numSlots = readDirectoryEntries(dirInode, entries);
+    for (int i = 0; i < numSlots; i++) {
+        if (entries[i].inum != -1 && name == entries[i].name) {
+            entries[i].inum = inum;
+
+            int blockIndex = i / numEntriesPerBlock;
+            disk->writeBlock(dirInode->direct[blockIndex], &entries[blockIndex * numEntriesPerBlock]);
+            return 0;
+        }
+    }
     return -ENOTFOUND;
 }
 
+bool LocalFileSystem::releaseBlocks(super_t *super, unsigned char *dataBitmap, unsigned int *refcounts,
+                                    inode_t *inode) {
+    bool refcountsChanged = false;
+
+    // Free data blocks used by the inode
+    int numBlocks = (inode->size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    if (UFS_HAS_INLINE_DATA(super, inode)) {
+        numBlocks = 0;  // the data lives in the inode itself
+        memset(inode->direct, 0, sizeof(inode->direct));
+    }
+    for (int i = 0; i < numBlocks; ++i) {
+        unsigned int blockNum = inode->direct[i];
+        if (blockNum != 0) {
+            refcountsChanged |= releaseDataBlock(super, dataBitmap, refcounts, blockNum);
+            inode->direct[i] = 0;
+        }
+    }
+
+    inode->size = 0;
+    return refcountsChanged;
+}
+
+bool LocalFileSystem::releaseInode(super_t *super, unsigned char *inodeBitmap, unsigned char *dataBitmap,
+                                   unsigned int *refcounts, inode_t *inodes, int inodeNumber) {
+    // Free the inode
+    inodeBitmap[inodeNumber / 8] &= ~(1 << (inodeNumber % 8));
+
+    return releaseBlocks(super, dataBitmap, refcounts, &inodes[inodeNumber]);
+}
+
+int LocalFileSystem::lookup(int parentInodeNumber, std::string name) {
+    TraceSpan span("lookup");
+    span.arg("name", name);
+    super_t super;
+    readSuperBlock(&super);
+
+    // Validate the parent inode number
+    if (parentInodeNumber < 0 || parentInodeNumber >= super.num_inodes) {
+        return -EINVALIDINODE;
+    }
+
+    inode_t parentInode;
+    if (stat(parentInodeNumber, &parentInode) < 0) {
+        return -EINVALIDINODE;
+    }
+
+    // Ensure the parent inode is a directory
+    if (parentInode.type != UFS_DIRECTORY) {
+        return -EINVALIDINODE;
+    }
+
+    return findDirectoryEntry(&super, &parentInode, name);
+}
+
 
 
 
@@ -194,11 +957,16 @@ int LocalFileSystem::lookup(int parentInodeNumber, std::string name) {
 
 
 int LocalFileSystem::stat(int inodeNumber, inode_t *inode) {
+    TraceSpan span("stat");
+    span.arg("inode", inodeNumber);
     super_t super;
     readSuperBlock(&super);
+    return readInode(&super, inodeNumber, inode);
+}
 
+int LocalFileSystem::readInode(super_t *super, int inodeNumber, inode_t *inode) {
     // Validate the inode number
-    if (inodeNumber < 0 || inodeNumber >= super.num_inodes) {
+    if (inodeNumber < 0 || inodeNumber >= super->num_inodes) {
         return -EINVALIDINODE;
     }
 
@@ -207,10 +975,10 @@ int LocalFileSystem::stat(int inodeNumber, inode_t *inode) {
     int blockOffset = (inodeNumber * sizeof(inode_t)) % UFS_BLOCK_SIZE;
 
     // Translate block-based address to absolute block number
-    int absoluteBlockNumber = super.inode_region_addr + blockIndex;
+    int absoluteBlockNumber = super->inode_region_addr + blockIndex;
 
     // Validate that the block index is within bounds
-    if (absoluteBlockNumber >= super.inode_region_addr + super.inode_region_len) {
+    if (absoluteBlockNumber >= super->inode_region_addr + super->inode_region_len) {
         return -EINVALIDINODE;
     }
 
@@ -230,11 +998,63 @@ int LocalFileSystem::stat(int inodeNumber, inode_t *inode) {
 
 
 
+int LocalFileSystem::readCompressed(super_t *super, inode_t *inode, inode_ext_t *ext, void *buffer, int size) {
+    char *buf = static_cast<char *>(buffer);
+    int numBlocks = (size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+
+    // Only the stored blocks holding the first numBlocks logical blocks are read
+    int storedSize = 0;
+    for (int i = 0; i < numBlocks; i++) {
+        storedSize += ext->clen[i];
+    }
+    int storedBlocks = (storedSize + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    if (storedBlocks > DIRECT_PTRS) {
+        return -EINVALIDINODE;
+    }
+
+    // The checksums cover the stored (compressed) blocks
+    unsigned int *checksums = loadChecksums(super);
+    std::vector<char> packed(storedBlocks * UFS_BLOCK_SIZE);
+    for (int i = 0; i < storedBlocks; i++) {
+        if (inode->direct[i] < static_cast<unsigned int>(super->data_region_addr) ||
+            inode->direct[i] >= static_cast<unsigned int>(super->data_region_addr + super->data_region_len)) {
+            delete[] checksums;
+            return -EINVALIDINODE;
+        }
+        if (readFileBlock(super, checksums, inode->direct[i], &packed[i * UFS_BLOCK_SIZE]) < 0) {
+            delete[] checksums;
+            return -ECORRUPT;
+        }
+    }
+    delete[] checksums;
+
+    int offset = 0;
+    char block[UFS_BLOCK_SIZE];
+    for (int i = 0; i < numBlocks; i++) {
+        int length = std::min(UFS_BLOCK_SIZE, inode->size - i * UFS_BLOCK_SIZE);
+        int toRead = std::min(UFS_BLOCK_SIZE, size - i * UFS_BLOCK_SIZE);
+
+        if (ext->clen[i] == length) {
+            memcpy(block, &packed[offset], length);  // stored as is
+        } else if (Lz4::decompress((const uint8_t *) &packed[offset], ext->clen[i], (uint8_t *) block, length) < 0) {
+            return -EINVALIDINODE;
+        }
+        memcpy(buf + i * UFS_BLOCK_SIZE, block, toRead);
+        offset += ext->clen[i];
+    }
+
+    return size;
+}
+
 int LocalFileSystem::read(int inodeNumber, void *buffer, int size) {
+    TraceSpan span("read");
+    span.arg("inode", inodeNumber);
+    super_t super;
+    readSuperBlock(&super);
     inode_t inode;
 
     // Fetch the inode metadata
-    if (stat(inodeNumber, &inode) < 0) {
+    if (readInode(&super, inodeNumber, &inode) < 0) {
         return -EINVALIDINODE;
     }
 
@@ -243,9 +1063,29 @@ int LocalFileSystem::read(int inodeNumber, void *buffer, int size) {
         return -EINVALIDSIZE;
     }
 
+    // Small files are served straight from the inode
+    if (UFS_HAS_INLINE_DATA(&super, &inode)) {
+        memcpy(buffer, inode.direct, size);
+        return size;
+    }
+
+    if (super.features & UFS_FEATURE_COMPRESSION) {
+        inode_ext_t ext;
+        readInodeExt(&super, inodeNumber, &ext);
+        if (ext.flags & UFS_INODE_COMPRESSED) {
+            return readCompressed(&super, &inode, &ext, buffer, size);
+        }
+    }
+
     char *buf = static_cast<char *>(buffer);
     int bytesRead = 0;
 
+    // Directory blocks have no checksums
+    unsigned int *checksums = NULL;
+    if (inode.type == UFS_REGULAR_FILE) {
+        checksums = loadChecksums(&super);
+    }
+
     // Iterate over direct block pointers
     for (int i = 0; i < DIRECT_PTRS && bytesRead < size; i++) {
         if (inode.direct[i] == 0 || inode.direct[i] == UINT_MAX ||
@@ -254,7 +1094,10 @@ int LocalFileSystem::read(int inodeNumber, void *buffer, int size) {
         }
 
         char blockBuffer[UFS_BLOCK_SIZE];
-        disk->readBlock(inode.direct[i], blockBuffer);
+        if (readFileBlock(&super, checksums, inode.direct[i], blockBuffer) < 0) {
+            delete[] checksums;
+            return -ECORRUPT;
+        }
 
         // Determine the number of bytes to read from the block
         int toRead = std::min(size - bytesRead, UFS_BLOCK_SIZE);
@@ -262,9 +1105,54 @@ int LocalFileSystem::read(int inodeNumber, void *buffer, int size) {
         bytesRead += toRead;
     }
 
+    delete[] checksums;
     return bytesRead;
 }
 
+int LocalFileSystem::scrub(int inodeNumber) {
+    super_t super;
+    readSuperBlock(&super);
+
+    inode_t inode;
+    if (readInode(&super, inodeNumber, &inode) < 0) {
+        return -EINVALIDINODE;
+    }
+
+    int inodeBitmapSize = (super.num_inodes + 7) / 8;
+    unsigned char *inodeBitmap = new unsigned char[inodeBitmapSize];
+    readInodeBitmap(&super, inodeBitmap);
+    bool allocated = (inodeBitmap[inodeNumber / 8] & (1 << (inodeNumber % 8))) != 0;
+    delete[] inodeBitmap;
+    if (!allocated) {
+        return -ENOTALLOCATED;
+    }
+    if (inode.type != UFS_REGULAR_FILE) {
+        return -EINVALIDTYPE;
+    }
+
+    unsigned int *checksums = loadChecksums(&super);
+    if (checksums == NULL || UFS_HAS_INLINE_DATA(&super, &inode)) {
+        delete[] checksums;
+        return 0;
+    }
+
+    // Compressed files end their direct[] early with zeros
+    int corrupt = 0;
+    int numBlocks = std::min(DIRECT_PTRS, (inode.size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE);
+    char block[UFS_BLOCK_SIZE];
+    for (int i = 0; i < numBlocks; i++) {
+        if (inode.direct[i] < static_cast<unsigned int>(super.data_region_addr) ||
+            inode.direct[i] >= static_cast<unsigned int>(super.data_region_addr + super.data_region_len)) {
+            continue;
+        }
+        if (readFileBlock(&super, checksums, inode.direct[i], block) < 0) {
+            corrupt++;
+        }
+    }
+
+    delete[] checksums;
+    return corrupt;
+}
 
 
 
@@ -274,15 +1162,20 @@ int LocalFileSystem::read(int inodeNumber, void *buffer, int size) {
 
 
 
-int LocalFileSystem::create(int parentInodeNumber, int type, std::string name) {
-    // Validate the name length
-    if (name.empty() || name.length() >= DIR_ENT_NAME_SIZE) {
-        return -EINVALIDNAME;
-    }
 
+int LocalFileSystem::create(int parentInodeNumber, int type, std::string name) {
+    TraceSpan span("create");
+    span.arg("name", name);
     // Load the superblock
     super_t super;
     readSuperBlock(&super);
+    bool longNames = (super.features & UFS_FEATURE_LONG_NAMES) != 0;
+
+    // Validate the name length
+    int maxNameLength = longNames ? DIR_REC_MAX_NAME_LEN : DIR_ENT_NAME_SIZE - 1;
+    if (name.empty() || (int) name.length() > maxNameLength) {
+        return -EINVALIDNAME;
+    }
 
     // Allocate memory for bitmaps and inodes
     int inodeBitmapSize = (super.num_inodes + 7) / 8;
@@ -317,50 +1210,21 @@ int LocalFileSystem::create(int parentInodeNumber, int type, std::string name) {
     }
 
     // Check if the name already exists in the parent directory
-    char buffer[UFS_BLOCK_SIZE];
-    int numEntriesPerBlock = UFS_BLOCK_SIZE / sizeof(dir_ent_t);
-
-    int numBlocks = (parentInode.size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
-
-
-    for (int i = 0; i < numBlocks; i++) {
-        if (parentInode.direct[i] == 0) {
-            continue;
+    int existingInodeNumber = findDirectoryEntry(&super, &parentInode, name);
+    if (existingInodeNumber != -ENOTFOUND) {
+        int result = existingInodeNumber;
+        if (existingInodeNumber < 0 || existingInodeNumber >= super.num_inodes ||
+            !(inodeBitmap[existingInodeNumber / 8] & (1 << (existingInodeNumber % 8)))) {
+            result = -EINVALIDINODE;
+        } else if (inodes[existingInodeNumber].type != type) {
+            result = -EINVALIDTYPE;
         }
 
-        disk->readBlock(parentInode.direct[i], buffer);
-        dir_ent_t *entries = (dir_ent_t *)buffer;
-
-        for (int j = 0; j < numEntriesPerBlock; j++) {
-            if (entries[j].inum != -1 && name == entries[j].name) {
-                int existingInodeNumber = entries[j].inum;
-
-                if (existingInodeNumber < 0 || existingInodeNumber >= super.num_inodes ||
-                    !(inodeBitmap[existingInodeNumber / 8] & (1 << (existingInodeNumber % 8)))) {
-                    // Clean up
-                    delete[] inodeBitmap;
-                    delete[] dataBitmap;
-                    delete[] inodes;
-                    return -EINVALIDINODE;
-                }
-
-                inode_t &existingInode = inodes[existingInodeNumber];
-
-                if (existingInode.type == type) {
-                    // Clean up
-                    delete[] inodeBitmap;
-                    delete[] dataBitmap;
-                    delete[] inodes;
-                    return existingInodeNumber;
-                } else {
-                    // Clean up
-                    delete[] inodeBitmap;
-                    delete[] dataBitmap;
-                    delete[] inodes;
-                    return -EINVALIDTYPE;
-                }
-            }
-        }
+        // Clean up
+        delete[] inodeBitmap;
+        delete[] dataBitmap;
+        delete[] inodes;
+        return result;
     }
 
     // Allocate a new inode
@@ -387,6 +1251,7 @@ int LocalFileSystem::create(int parentInodeNumber, int type, std::string name) {
     newInode.type = type;
     newInode.size = 0;
 
+    int newBlockNum = -1;
     if (type == UFS_DIRECTORY) {
         // Allocate a data block for the new directory
         int newBlockIndex = -1;
@@ -405,243 +1270,525 @@ int LocalFileSystem::create(int parentInodeNumber, int type, std::string name) {
             return -ENOTENOUGHSPACE;
         }
 
-        dir_ent_t newDirEntries[numEntriesPerBlock];
-        for (int k = 0; k < numEntriesPerBlock; k++) {
-            newDirEntries[k].inum = -1; // Mark as unused
-            memset(newDirEntries[k].name, 0, DIR_ENT_NAME_SIZE);
+        newBlockNum = super.data_region_addr + newBlockIndex;
+        newInode.direct[0] = newBlockNum;
+    }
+
+    // Add the new entry to the parent directory. Nothing has been written
+    // yet, so running out of room here leaves the disk untouched.
+    int ret = addDirectoryEntry(&super, &parentInode, dataBitmap, name, newInodeIndex);
+    if (ret < 0) {
+        // Clean up
+        delete[] inodeBitmap;
+        delete[] dataBitmap;
+        delete[] inodes;
+        return ret;
+    }
+
+    if (type == UFS_DIRECTORY) {
+        if (longNames) {
+            std::vector<DirectoryEntry> records(2);
+            records[0].name = ".";
+            records[0].inum = newInodeIndex;
+            records[1].name = "..";
+            records[1].inum = parentInodeNumber;
+
+            unsigned char block[UFS_BLOCK_SIZE];
+            encodeDirBlock(records, block);
+            disk->writeBlock(newBlockNum, block);
+            newInode.size = UFS_BLOCK_SIZE;
+        } else {
+            int numEntriesPerBlock = UFS_BLOCK_SIZE / sizeof(dir_ent_t);
+            dir_ent_t newDirEntries[numEntriesPerBlock];
+            for (int k = 0; k < numEntriesPerBlock; k++) {
+                newDirEntries[k].inum = -1; // Mark as unused
+                memset(newDirEntries[k].name, 0, DIR_ENT_NAME_SIZE);
+            }
+            strncpy(newDirEntries[0].name, ".", DIR_ENT_NAME_SIZE - 1);
+            newDirEntries[0].name[DIR_ENT_NAME_SIZE - 1] = '\0';
+            newDirEntries[0].inum = newInodeIndex;
+
+            strncpy(newDirEntries[1].name, "..", DIR_ENT_NAME_SIZE - 1);
+            newDirEntries[1].name[DIR_ENT_NAME_SIZE - 1] = '\0';
+            newDirEntries[1].inum = parentInodeNumber;
+
+            disk->writeBlock(newBlockNum, newDirEntries);
+            newInode.size = 2 * sizeof(dir_ent_t);
         }
-        strncpy(newDirEntries[0].name, ".", DIR_ENT_NAME_SIZE - 1);
-        newDirEntries[0].name[DIR_ENT_NAME_SIZE - 1] = '\0';
-        newDirEntries[0].inum = newInodeIndex;
+    }
+
+    // The inode's last owner may have left compression metadata behind; its
+    // version carries on so the new file can't be mistaken for the old one
+    if (super.features & UFS_FEATURE_VERSIONS) {
+        inode_ext_t ext;
+        readInodeExt(&super, newInodeIndex, &ext);
+        ext.flags = 0;
+        memset(ext.clen, 0, sizeof(ext.clen));
+        bumpVersion(&super, &ext);
+        writeInodeExt(&super, newInodeIndex, &ext);
+    }
+
+    // Write back changes
+    writeInodeBitmap(&super, inodeBitmap);
+    writeDataBitmap(&super, dataBitmap);
+    writeInodeRegion(&super, inodes);
+
+    // Clean up
+    delete[] inodeBitmap;
+    delete[] dataBitmap;
+    delete[] inodes;
+
+    return newInodeIndex;
+}
 
-        strncpy(newDirEntries[1].name, "..", DIR_ENT_NAME_SIZE - 1);
-        newDirEntries[1].name[DIR_ENT_NAME_SIZE - 1] = '\0';
-        newDirEntries[1].inum = parentInodeNumber;
 
-        int newBlockNum = super.data_region_addr + newBlockIndex;
-        disk->writeBlock(newBlockNum, newDirEntries);
 
-        newInode.direct[0] = newBlockNum;
-        newInode.size = 2 * sizeof(dir_ent_t);
+
+
+
+
+
+
+
+
+
+
+
+int LocalFileSystem::write(int inodeNumber, const void *buffer, int size) {
+    TraceSpan span("write");
+    span.arg("inode", inodeNumber);
+    // Check for invalid size
+    if (size < 0) {
+        return -EINVALIDSIZE;
     }
 
-    // Try to add the new entry to the parent directory
-    bool added = false;
-    for (int i = 0; i < numBlocks; i++) {
-        if (parentInode.direct[i] == 0) {
+    // Read the superblock
+    super_t super;
+    readSuperBlock(&super);
+
+    // Get the inode
+    inode_t inode;
+    int ret = readInode(&super, inodeNumber, &inode);
+    if (ret < 0) {
+        return -EINVALIDINODE;
+    }
+
+    // Check inode type
+    if (inode.type != UFS_REGULAR_FILE) {
+        return -EINVALIDTYPE;
+    }
+
+    // Calculate blocks needed. Files small enough to live in the inode need
+    // none, and a file that was inline has none to reuse.
+    bool makeInline = (super.features & UFS_FEATURE_INLINE_DATA) && size <= UFS_INLINE_DATA_SIZE;
+    int blocksNeeded = makeInline ? 0 : (size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    int currentBlocks = (inode.size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    if (UFS_HAS_INLINE_DATA(&super, &inode)) {
+        currentBlocks = 0;
+        memset(inode.direct, 0, sizeof(inode.direct));
+    }
+
+    // Check if the file size exceeds maximum allowed size
+    if (blocksNeeded > DIRECT_PTRS) {
+        return -EINVALIDSIZE; // Or define a specific error code for exceeding max file size
+    }
+
+    const char *data = static_cast<const char *>(buffer);
+
+    // On compressing images the blocks that go to disk are the packed,
+    // compressed stream rather than the data itself, when that is smaller
+    inode_ext_t ext;
+    readInodeExt(&super, inodeNumber, &ext);
+    ext.flags &= ~UFS_INODE_COMPRESSED;
+    memset(ext.clen, 0, sizeof(ext.clen));
+
+    std::vector<char> packed;
+    int storedSize = size;
+    if ((super.features & UFS_FEATURE_COMPRESSION) && blocksNeeded > 0 &&
+        compressBlocks(data, size, packed, ext.clen)) {
+        ext.flags |= UFS_INODE_COMPRESSED;
+        data = packed.data();
+        storedSize = packed.size();
+        blocksNeeded = (storedSize + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    } else {
+        memset(ext.clen, 0, sizeof(ext.clen));
+    }
+
+    // Read data bitmap, it only goes back to disk if blocks come or go
+    int dataBitmapSize = (super.num_data + 7) / 8;
+    unsigned char *dataBitmap = new unsigned char[dataBitmapSize];
+    readDataBitmap(&super, dataBitmap);
+    bool dataBitmapChanged = false;
+    unsigned int *refcounts = loadRefcounts(&super);
+    bool refcountsChanged = false;
+    unsigned int *checksums = loadChecksums(&super);
+    bool checksumsChanged = false;
+
+    // Every check comes before the first block is written: a write that
+    // stopped partway would leave blocks changed in place with their old
+    // checksums. Blocks that can't be rewritten in place need a new one
+    // (sharing a duplicate only ever needs fewer).
+    int blocksToAllocate = 0;
+    for (int i = 0; i < blocksNeeded; i++) {
+        if (i >= currentBlocks || inode.direct[i] == 0) {
+            blocksToAllocate++;
             continue;
         }
+        if (inode.direct[i] < static_cast<unsigned int>(super.data_region_addr) ||
+            inode.direct[i] >= static_cast<unsigned int>(super.data_region_addr + super.data_region_len)) {
+            delete[] dataBitmap;
+            delete[] refcounts;
+            delete[] checksums;
+            return -EINVALIDINODE;
+        }
+        if (refcounts != NULL && refcounts[inode.direct[i] - super.data_region_addr] > 0) {
+            blocksToAllocate++;  // shared, so it gets copied
+        }
+    }
+    if (blocksToAllocate > 0 && countFreeBlocks(&super, dataBitmap) < blocksToAllocate) {
+        delete[] dataBitmap;
+        delete[] refcounts;
+        delete[] checksums;
+        return -ENOTENOUGHSPACE;
+    }
 
-        disk->readBlock(parentInode.direct[i], buffer);
-        dir_ent_t *entries = (dir_ent_t *)buffer;
+    // On dedup images, blocks of regular files are indexed by fingerprint so
+    // a block with the same contents is shared rather than written again.
+    // Only the fingerprint region blocks that change are written back.
+    bool dedup = (super.features & UFS_FEATURE_DEDUP) && blocksNeeded > 0;
+    std::set<int> fingerprintBlocksChanged;
+    if (dedup) {
+        loadFingerprintIndex(&super, dataBitmap);
+    }
 
-        for (int j = 0; j < numEntriesPerBlock; j++) {
-            if (entries[j].inum == -1) {
-                strncpy(entries[j].name, name.c_str(), DIR_ENT_NAME_SIZE - 1);
-                entries[j].name[DIR_ENT_NAME_SIZE - 1] = '\0';
-                entries[j].inum = newInodeIndex;
-                disk->writeBlock(parentInode.direct[i], buffer);
-                parentInode.size += sizeof(dir_ent_t);
-                added = true;
-                break;
-            }
+    // Allocate or reuse data blocks
+    for (int i = 0; i < blocksNeeded; i++) {
+        int blockOffset = i * UFS_BLOCK_SIZE;
+        int bytesToWrite = std::min(UFS_BLOCK_SIZE, storedSize - blockOffset);
+
+        // The last block is zero padded
+        const char *blockData = data + blockOffset;
+        char tempBuffer[UFS_BLOCK_SIZE];
+        if (bytesToWrite < UFS_BLOCK_SIZE) {
+            std::memcpy(tempBuffer, blockData, bytesToWrite);
+            memset(tempBuffer + bytesToWrite, 0, UFS_BLOCK_SIZE - bytesToWrite);
+            blockData = tempBuffer;
         }
-        if (added) {
-            break;
+
+        bool reuse = i < currentBlocks && inode.direct[i] != 0;
+
+        unsigned long long fingerprint = 0;
+        if (dedup) {
+            fingerprint = blockFingerprint(blockData);
+
+            // A fingerprint match only counts once the contents compare equal
+            std::unordered_map<unsigned long long, unsigned int>::iterator match = fingerprintIndex.find(fingerprint);
+            char existing[UFS_BLOCK_SIZE];
+            if (match != fingerprintIndex.end()) {
+                disk->readBlock(match->second, existing);
+            }
+            if (match != fingerprintIndex.end() && memcmp(existing, blockData, UFS_BLOCK_SIZE) == 0) {
+                unsigned int matchBlock = match->second;
+                if (reuse && inode.direct[i] == matchBlock) {
+                    continue;  // this block already holds exactly that
+                }
+
+                refcounts[matchBlock - super.data_region_addr]++;
+                refcountsChanged = true;
+                if (reuse) {
+                    if (releaseDataBlock(&super, dataBitmap, refcounts, inode.direct[i])) {
+                        refcountsChanged = true;
+                    } else {
+                        dataBitmapChanged = true;
+                    }
+                }
+                inode.direct[i] = matchBlock;
+                continue;
+            }
         }
-    }
 
-    if (!added) {
-        // Need to allocate a new data block for the parent directory
-        if (numBlocks >= DIRECT_PTRS) {
-            // Cannot allocate more blocks
-            // Clean up
-            delete[] inodeBitmap;
-            delete[] dataBitmap;
-            delete[] inodes;
-            return -ENOTENOUGHSPACE;
+        if (reuse) {
+            // Copy on write: a block shared with another file stays as it is
+            // for the other owners and this file gets a block of its own
+            int dataBlockIndex = inode.direct[i] - super.data_region_addr;
+            if (refcounts != NULL && refcounts[dataBlockIndex] > 0) {
+                refcounts[dataBlockIndex]--;
+                refcountsChanged = true;
+                reuse = false;
+            } else if (dedup) {
+                forgetFingerprint(&super, inode.direct[i]);
+            }
         }
 
-        // Allocate new data block
-        int newBlockIndex = -1;
-        for (int i = 0; i < super.num_data; i++) {
-            if (!(dataBitmap[i / 8] & (1 << (i % 8)))) {
-                newBlockIndex = i;
-                dataBitmap[i / 8] |= (1 << (i % 8));
-                break;
+        if (!reuse) {
+            // Allocate a new data block
+            int newBlockIndex = -1;
+            for (int j = 0; j < super.num_data; j++) {
+                if (!(dataBitmap[j / 8] & (1 << (j % 8)))) {
+                    dataBitmap[j / 8] |= (1 << (j % 8));
+                    dataBitmapChanged = true;
+                    newBlockIndex = j;
+                    break;
+                }
+            }
+            if (newBlockIndex == -1) {
+                delete[] dataBitmap;
+                delete[] refcounts;
+                delete[] checksums;
+                fingerprintsLoaded = false;  // may index blocks that were never written
+                return -ENOTENOUGHSPACE;
             }
+
+            inode.direct[i] = super.data_region_addr + newBlockIndex;
         }
-        if (newBlockIndex == -1) {
-            // Clean up
-            delete[] inodeBitmap;
-            delete[] dataBitmap;
-            delete[] inodes;
-            return -ENOTENOUGHSPACE;
+
+        // Overwriting a file mostly rewrites what is already there, and a
+        // block read is much cheaper than a synced block write
+        bool unchanged = false;
+        if (reuse) {
+            char existing[UFS_BLOCK_SIZE];
+            disk->readBlock(inode.direct[i], existing);
+            unchanged = memcmp(existing, blockData, UFS_BLOCK_SIZE) == 0;
+        }
+        if (!unchanged) {
+            disk->writeBlock(inode.direct[i], (void *) blockData);
+        }
+        if (recordChecksum(&super, checksums, inode.direct[i], blockData)) {
+            checksumsChanged = true;
         }
 
-        int newBlockNum = super.data_region_addr + newBlockIndex;
-        parentInode.direct[numBlocks] = newBlockNum; // Use numBlocks as the index
-        memset(buffer, 0, UFS_BLOCK_SIZE);
+        if (dedup) {
+            int dataBlockIndex = inode.direct[i] - super.data_region_addr;
+            fingerprints[dataBlockIndex] = fingerprint;
+            fingerprintBlocksChanged.insert(dataBlockIndex / UFS_FINGERPRINTS_PER_BLOCK);
+            fingerprintIndex.emplace(fingerprint, inode.direct[i]);
+        }
+    }
 
-        dir_ent_t *entries = (dir_ent_t *)buffer;
-        for (int k = 0; k < numEntriesPerBlock; k++) {
-            entries[k].inum = -1; // Initialize entries as unused
-            memset(entries[k].name, 0, DIR_ENT_NAME_SIZE);
+    // Free unused data blocks if the new size is smaller
+    for (int i = blocksNeeded; i < currentBlocks; i++) {
+        if (inode.direct[i] != 0) {
+            // Mark the data block as free in the data bitmap, or drop our
+            // reference if it is shared
+            if (releaseDataBlock(&super, dataBitmap, refcounts, inode.direct[i])) {
+                refcountsChanged = true;
+            } else {
+                dataBitmapChanged = true;
+            }
+            // Clear the direct pointer
+            inode.direct[i] = 0;
         }
-        strncpy(entries[0].name, name.c_str(), DIR_ENT_NAME_SIZE - 1);
-        entries[0].name[DIR_ENT_NAME_SIZE - 1] = '\0';
-        entries[0].inum = newInodeIndex;
+    }
 
-        disk->writeBlock(newBlockNum, buffer);
-        parentInode.size += sizeof(dir_ent_t);
+    // Update inode size
+    inode.size = size;
 
+    if (makeInline) {
+        memset(inode.direct, 0, sizeof(inode.direct));
+        memcpy(inode.direct, data, size);
     }
 
+    if (super.inode_ext_len != 0) {
+        bumpVersion(&super, &ext);
+        writeInodeExt(&super, inodeNumber, &ext);
+    }
 
-       inodes[parentInodeNumber] =  parentInode;
-        inodes[newInodeIndex] = newInode;
-    // Write back changes
-    writeInodeBitmap(&super, inodeBitmap);
-    writeDataBitmap(&super, dataBitmap);
-    writeInodeRegion(&super, inodes);
-
-    // Clean up
-    delete[] inodeBitmap;
+    // Write back the data bitmap
+    if (dataBitmapChanged) {
+        writeDataBitmap(&super, dataBitmap);
+    }
+    if (refcountsChanged) {
+        writeRefcounts(&super, refcounts);
+    }
+    for (int block : fingerprintBlocksChanged) {
+        disk->writeBlock(super.fingerprint_addr + block, &fingerprints[block * UFS_FINGERPRINTS_PER_BLOCK]);
+    }
+    if (checksumsChanged) {
+        writeChecksums(&super, checksums);
+    }
     delete[] dataBitmap;
-    delete[] inodes;
-
-    return newInodeIndex;
-}
-
-
-
-
-
-
-
-
-
-
+    delete[] refcounts;
+    delete[] checksums;
 
+    // Read and update the inode region
+    inode_t *inodes = new inode_t[super.num_inodes];
+    readInodeRegion(&super, inodes);
+    if (memcmp(&inodes[inodeNumber], &inode, sizeof(inode_t)) != 0) {
+        inodes[inodeNumber] = inode;
+        writeInodeRegion(&super, inodes);
+    }
+    delete[] inodes;
 
+    if(size<0) return -EINVALIDSIZE;
 
+    return size;
+}
 
-int LocalFileSystem::write(int inodeNumber, const void *buffer, int size) {
+int LocalFileSystem::append(int inodeNumber, const void *buffer, int size) {
+    TraceSpan span("append");
+    span.arg("inode", inodeNumber);
     // Check for invalid size
     if (size < 0) {
         return -EINVALIDSIZE;
     }
 
-    // Get the inode
+    super_t super;
+    readSuperBlock(&super);
+
     inode_t inode;
-    int ret = stat(inodeNumber, &inode);
-    if (ret < 0) {
+    if (readInode(&super, inodeNumber, &inode) < 0) {
         return -EINVALIDINODE;
     }
-
-    // Check inode type
     if (inode.type != UFS_REGULAR_FILE) {
         return -EINVALIDTYPE;
     }
-
-    // Read the superblock
-    super_t super;
-    readSuperBlock(&super);
-
-    // Calculate blocks needed
-    int blocksNeeded = (size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
-    int currentBlocks = (inode.size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
-
-    // Check if the file size exceeds maximum allowed size
-    if (blocksNeeded > DIRECT_PTRS) {
-        return -EINVALIDSIZE; // Or define a specific error code for exceeding max file size
+    if (size > MAX_FILE_SIZE - inode.size) {
+        return -EINVALIDSIZE;
+    }
+    int newSize = inode.size + size;
+
+    // Inline and compressed files, and dedup images, don't map file offsets
+    // straight onto blocks. Rewrite those whole; write() leaves the blocks
+    // that didn't change alone.
+    inode_ext_t ext;
+    readInodeExt(&super, inodeNumber, &ext);
+    if (UFS_HAS_INLINE_DATA(&super, &inode) || (ext.flags & UFS_INODE_COMPRESSED) ||
+        (super.features & (UFS_FEATURE_DEDUP | UFS_FEATURE_COMPRESSION))) {
+        char *contents = new char[newSize];
+        int ret = read(inodeNumber, contents, inode.size);
+        if (ret >= 0) {
+            memcpy(contents + inode.size, buffer, size);
+            ret = write(inodeNumber, contents, newSize);
+        }
+        delete[] contents;
+        return ret < 0 ? ret : size;
     }
 
-    // Read data bitmap
     int dataBitmapSize = (super.num_data + 7) / 8;
     unsigned char *dataBitmap = new unsigned char[dataBitmapSize];
     readDataBitmap(&super, dataBitmap);
+    bool dataBitmapChanged = false;
+    unsigned int *refcounts = loadRefcounts(&super);
+    bool refcountsChanged = false;
+    unsigned int *checksums = loadChecksums(&super);
+    bool checksumsChanged = false;
+
+    // As in write(), make sure of the space before writing anything: the
+    // new blocks, plus a copy of the old last block if it's partly used and
+    // shared
+    int oldBlocks = (inode.size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    int blocksToAllocate = (newSize + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE - oldBlocks;
+    if (inode.size % UFS_BLOCK_SIZE != 0) {
+        unsigned int tailBlock = inode.direct[oldBlocks - 1];
+        if (tailBlock == 0) {
+            blocksToAllocate++;
+        } else if (refcounts != NULL && tailBlock >= static_cast<unsigned int>(super.data_region_addr) &&
+                   tailBlock < static_cast<unsigned int>(super.data_region_addr + super.data_region_len) &&
+                   refcounts[tailBlock - super.data_region_addr] > 0) {
+            blocksToAllocate++;
+        }
+    }
+    if (blocksToAllocate > 0 && countFreeBlocks(&super, dataBitmap) < blocksToAllocate) {
+        delete[] dataBitmap;
+        delete[] refcounts;
+        delete[] checksums;
+        return -ENOTENOUGHSPACE;
+    }
 
+    // Only the old last block, if it was partly used, and the blocks after
+    // it are touched
     const char *data = static_cast<const char *>(buffer);
+    int written = 0;
+    while (written < size) {
+        int offset = inode.size + written;
+        int i = offset / UFS_BLOCK_SIZE;
+        int blockOffset = offset % UFS_BLOCK_SIZE;
+        int bytesToWrite = std::min(UFS_BLOCK_SIZE - blockOffset, size - written);
 
-    // Allocate or reuse data blocks
-    for (int i = 0; i < blocksNeeded; i++) {
-        int blockOffset = i * UFS_BLOCK_SIZE;
-        int bytesToWrite = std::min(UFS_BLOCK_SIZE, size - blockOffset);
-
-        if (i < currentBlocks && inode.direct[i] != 0) {
-            // Reuse existing block
+        char blockData[UFS_BLOCK_SIZE];
+        bool allocate = true;
+        if (blockOffset > 0 && inode.direct[i] != 0) {
             if (inode.direct[i] < static_cast<unsigned int>(super.data_region_addr) ||
                 inode.direct[i] >= static_cast<unsigned int>(super.data_region_addr + super.data_region_len)) {
                 delete[] dataBitmap;
+                delete[] refcounts;
+                delete[] checksums;
                 return -EINVALIDINODE;
             }
+            // A corrupt tail would otherwise get a fresh, matching checksum
+            if (readFileBlock(&super, checksums, inode.direct[i], blockData) < 0) {
+                delete[] dataBitmap;
+                delete[] refcounts;
+                delete[] checksums;
+                return -ECORRUPT;
+            }
+            allocate = false;
 
-            // Write data to existing block
-            if (bytesToWrite < UFS_BLOCK_SIZE) {
-                char tempBuffer[UFS_BLOCK_SIZE] = {0};
-                std::memcpy(tempBuffer, data + blockOffset, bytesToWrite);
-                disk->writeBlock(inode.direct[i], tempBuffer);
-            } else {
-                disk->writeBlock(inode.direct[i], (void *)(data + blockOffset));
+            // Copy on write, as in write()
+            int dataBlockIndex = inode.direct[i] - super.data_region_addr;
+            if (refcounts != NULL && refcounts[dataBlockIndex] > 0) {
+                refcounts[dataBlockIndex]--;
+                refcountsChanged = true;
+                allocate = true;
             }
         } else {
-            // Allocate a new data block
+            memset(blockData, 0, blockOffset);
+        }
+        memcpy(blockData + blockOffset, data + written, bytesToWrite);
+        memset(blockData + blockOffset + bytesToWrite, 0, UFS_BLOCK_SIZE - blockOffset - bytesToWrite);
+
+        if (allocate) {
             int newBlockIndex = -1;
             for (int j = 0; j < super.num_data; j++) {
                 if (!(dataBitmap[j / 8] & (1 << (j % 8)))) {
                     dataBitmap[j / 8] |= (1 << (j % 8));
+                    dataBitmapChanged = true;
                     newBlockIndex = j;
                     break;
                 }
             }
             if (newBlockIndex == -1) {
                 delete[] dataBitmap;
+                delete[] refcounts;
+                delete[] checksums;
                 return -ENOTENOUGHSPACE;
             }
-
-            int newBlockNum = super.data_region_addr + newBlockIndex;
-            inode.direct[i] = newBlockNum;
-
-            // Write data to new block
-            if (bytesToWrite < UFS_BLOCK_SIZE) {
-                char tempBuffer[UFS_BLOCK_SIZE] = {0};
-                std::memcpy(tempBuffer, data + blockOffset, bytesToWrite);
-                disk->writeBlock(newBlockNum, tempBuffer);
-            } else {
-                disk->writeBlock(newBlockNum, (void *)(data + blockOffset));
-            }
+            inode.direct[i] = super.data_region_addr + newBlockIndex;
         }
-    }
 
-    // Free unused data blocks if the new size is smaller
-    for (int i = blocksNeeded; i < currentBlocks; i++) {
-        if (inode.direct[i] != 0) {
-            // Mark the data block as free in the data bitmap
-            int dataBlockIndex = inode.direct[i] - super.data_region_addr;
-            dataBitmap[dataBlockIndex / 8] &= ~(1 << (dataBlockIndex % 8));
-            // Clear the direct pointer
-            inode.direct[i] = 0;
+        disk->writeBlock(inode.direct[i], blockData);
+        if (recordChecksum(&super, checksums, inode.direct[i], blockData)) {
+            checksumsChanged = true;
         }
+        written += bytesToWrite;
     }
 
-    // Update inode size
-    inode.size = size;
+    inode.size = newSize;
 
+    if (super.features & UFS_FEATURE_VERSIONS) {
+        bumpVersion(&super, &ext);
+        writeInodeExt(&super, inodeNumber, &ext);
+    }
 
-    // Write back the data bitmap
-    writeDataBitmap(&super, dataBitmap);
+    if (dataBitmapChanged) {
+        writeDataBitmap(&super, dataBitmap);
+    }
+    if (refcountsChanged) {
+        writeRefcounts(&super, refcounts);
+    }
+    if (checksumsChanged) {
+        writeChecksums(&super, checksums);
+    }
     delete[] dataBitmap;
+    delete[] refcounts;
+    delete[] checksums;
 
-    // Read and update the inode region
     inode_t *inodes = new inode_t[super.num_inodes];
     readInodeRegion(&super, inodes);
     inodes[inodeNumber] = inode;
     writeInodeRegion(&super, inodes);
     delete[] inodes;
 
-    if(size<0) return -EINVALIDSIZE;
-
     return size;
 }
 
@@ -668,9 +1815,121 @@ int LocalFileSystem::write(int inodeNumber, const void *buffer, int size) {
 
 
 
+
+
+int LocalFileSystem::copy(int srcInodeNumber, int dstInodeNumber) {
+    TraceSpan span("copy");
+    super_t super;
+    readSuperBlock(&super);
+
+    inode_t srcInode;
+    inode_t dstInode;
+    if (readInode(&super, srcInodeNumber, &srcInode) < 0 || readInode(&super, dstInodeNumber, &dstInode) < 0) {
+        return -EINVALIDINODE;
+    }
+    if (srcInode.type != UFS_REGULAR_FILE || dstInode.type != UFS_REGULAR_FILE) {
+        return -EINVALIDTYPE;
+    }
+    if (srcInodeNumber == dstInodeNumber) {
+        return srcInode.size;
+    }
+
+    unsigned char *dataBitmap = new unsigned char[super.data_bitmap_len * UFS_BLOCK_SIZE];
+    readDataBitmap(&super, dataBitmap);
+    unsigned int *refcounts = loadRefcounts(&super);
+
+    // The destination's old contents go first. Nothing is written until the
+    // copy is known to fit, so a failure leaves the destination as it was.
+    releaseBlocks(&super, dataBitmap, refcounts, &dstInode);
+    dstInode.size = srcInode.size;
+    memcpy(dstInode.direct, srcInode.direct, sizeof(dstInode.direct));
+
+    int numBlocks = (srcInode.size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
+    if (UFS_HAS_INLINE_DATA(&super, &srcInode)) {
+        numBlocks = 0;  // copying the inode copied the data
+    }
+
+    std::vector<unsigned int> copiedBlocks;
+    for (int i = 0; i < numBlocks; i++) {
+        if (srcInode.direct[i] == 0) {
+            continue;  // past the last block of a compressed file
+        }
+        int dataBlockIndex = srcInode.direct[i] - super.data_region_addr;
+        if (refcounts != NULL) {
+            // Share the block, the first write to either file copies it
+            refcounts[dataBlockIndex]++;
+            continue;
+        }
+
+        // Without reference counts the data has to be duplicated
+        int newBlockIndex = -1;
+        for (int j = 0; j < super.num_data; j++) {
+            if (!(dataBitmap[j / 8] & (1 << (j % 8)))) {
+                dataBitmap[j / 8] |= (1 << (j % 8));
+                newBlockIndex = j;
+                break;
+            }
+        }
+        if (newBlockIndex == -1) {
+            delete[] dataBitmap;
+            delete[] refcounts;
+            return -ENOTENOUGHSPACE;
+        }
+
+        dstInode.direct[i] = super.data_region_addr + newBlockIndex;
+        copiedBlocks.push_back(i);
+    }
+
+    // A copied block carries the source's checksum along with its bytes, so
+    // a corrupt source block stays detectable in the copy
+    unsigned int *checksums = loadChecksums(&super);
+    unsigned char block[UFS_BLOCK_SIZE];
+    for (unsigned int i : copiedBlocks) {
+        disk->readBlock(srcInode.direct[i], block);
+        disk->writeBlock(dstInode.direct[i], block);
+        if (checksums != NULL) {
+            checksums[dstInode.direct[i] - super.data_region_addr] =
+                checksums[srcInode.direct[i] - super.data_region_addr];
+        }
+    }
+
+    writeDataBitmap(&super, dataBitmap);
+    if (refcounts != NULL) {
+        writeRefcounts(&super, refcounts);
+    }
+    if (checksums != NULL && !copiedBlocks.empty()) {
+        writeChecksums(&super, checksums);
+    }
+    delete[] checksums;
+
+    inode_t *inodes = new inode_t[super.num_inodes];
+    readInodeRegion(&super, inodes);
+    inodes[dstInodeNumber] = dstInode;
+    writeInodeRegion(&super, inodes);
+
+    // The blocks only make sense with the source's compression metadata,
+    // while the version stays the destination's own
+    if (super.inode_ext_len != 0) {
+        inode_ext_t srcExt, dstExt;
+        readInodeExt(&super, srcInodeNumber, &srcExt);
+        readInodeExt(&super, dstInodeNumber, &dstExt);
+        srcExt.version = dstExt.version;
+        srcExt.mtime = dstExt.mtime;
+        bumpVersion(&super, &srcExt);
+        writeInodeExt(&super, dstInodeNumber, &srcExt);
+    }
+
+    delete[] inodes;
+    delete[] dataBitmap;
+    delete[] refcounts;
+
+    return dstInode.size;
+}
 
 
 int LocalFileSystem::unlink(int parentInodeNumber, std::string name) {
+    TraceSpan span("unlink");
+    span.arg("name", name);
     // Step 1: Read superblock
     super_t super;
     readSuperBlock(&super);
@@ -706,57 +1965,27 @@ int LocalFileSystem::unlink(int parentInodeNumber, std::string name) {
     }
 
     // Step 5: Check if name is valid and not "." or ".."
-    if (name == "." || name == ".." || name.empty() || name.length() >= DIR_ENT_NAME_SIZE) {
+    bool longNames = (super.features & UFS_FEATURE_LONG_NAMES) != 0;
+    int maxNameLength = longNames ? DIR_REC_MAX_NAME_LEN : DIR_ENT_NAME_SIZE - 1;
+    if (name == "." || name == ".." || name.empty() || (int) name.length() > maxNameLength) {
         delete[] inodeBitmap;
         delete[] inodes;
         return -EUNLINKNOTALLOWED;
     }
 
-    // Step 6: Read the directory entries of parentInode
-    int dirSize = inodes[parentInodeNumber].size;
-    int totalBlocks = (dirSize + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
-    int maxEntriesPerBlock = UFS_BLOCK_SIZE / sizeof(dir_ent_t);
-
-    char *dirData = new char[dirSize];
-    int bytesRead = 0;
-
-    for (int i = 0; i < totalBlocks && bytesRead < dirSize; ++i) {
-        unsigned int blockNum = inodes[parentInodeNumber].direct[i];
-        if (blockNum == 0) continue;
-
-        char blockData[UFS_BLOCK_SIZE];
-        disk->readBlock(blockNum, blockData);
-        int toRead = std::min(UFS_BLOCK_SIZE, dirSize - bytesRead);
-        memcpy(dirData + bytesRead, blockData, toRead);
-        bytesRead += toRead;
-    }
-
-    // Interpret dirData as an array of dir_ent_t
-    dir_ent_t *dirEntries = (dir_ent_t *)dirData;
-    int numEntries = dirSize / sizeof(dir_ent_t);
-
-    // Find the entry to unlink
-    int entryIndex = -1;
-    for (int i = 0; i < numEntries; ++i) {
-        if (std::string(dirEntries[i].name) == name) {
-            entryIndex = i;
-            break;
-        }
-    }
+    // Step 6: Find the entry to unlink
+    inode_t *parentInode = &inodes[parentInodeNumber];
+    int entryInodeNumber = findDirectoryEntry(&super, parentInode, name);
 
     // If entry not found, return success (not an error per spec)
-    if (entryIndex == -1) {
-        delete[] dirData;
+    if (entryInodeNumber == -ENOTFOUND) {
         delete[] inodeBitmap;
         delete[] inodes;
         return 0;
     }
 
-    int entryInodeNumber = dirEntries[entryIndex].inum;
-
-    // Step 8: Validate entryInodeNumber
+    // Step 7: Validate entryInodeNumber
     if (entryInodeNumber < 0 || entryInodeNumber >= super.num_inodes) {
-        delete[] dirData;
         delete[] inodeBitmap;
         delete[] inodes;
         return -EINVALIDINODE;
@@ -764,80 +1993,39 @@ int LocalFileSystem::unlink(int parentInodeNumber, std::string name) {
 
     // Check if entry inode is allocated
     if (!(inodeBitmap[entryInodeNumber / 8] & (1 << (entryInodeNumber % 8)))) {
-        delete[] dirData;
         delete[] inodeBitmap;
         delete[] inodes;
         return -ENOTALLOCATED;
     }
 
-    inode_t *entryInode = &inodes[entryInodeNumber];
-
-    // If entry is a directory, check if it is empty
-    if (entryInode->type == UFS_DIRECTORY && entryInode->size > 2 * static_cast<int>(sizeof(dir_ent_t))) {
-    // Directory is not empty (has more than "." and "..")
-    delete[] dirData;
-    delete[] inodeBitmap;
-    delete[] inodes;
-    return -EDIRNOTEMPTY;
+    // If entry is a directory, check if it is empty (only "." and "..")
+    if (inodes[entryInodeNumber].type == UFS_DIRECTORY) {
+        std::vector<DirectoryEntry> childEntries;
+        if (listDirectory(&super, &inodes[entryInodeNumber], childEntries) > 2) {
+            delete[] inodeBitmap;
+            delete[] inodes;
+            return -EDIRNOTEMPTY;
+        }
     }
 
-
-    // Free the inode
-    inodeBitmap[entryInodeNumber / 8] &= ~(1 << (entryInodeNumber % 8));
-
-    // Free data blocks used by the inode
+    // Step 8: Free the inode and its blocks, then drop the entry
     unsigned char *dataBitmap = new unsigned char[super.data_bitmap_len * UFS_BLOCK_SIZE];
     readDataBitmap(&super, dataBitmap);
+    unsigned int *refcounts = loadRefcounts(&super);
 
-    int numBlocks = (entryInode->size + UFS_BLOCK_SIZE - 1) / UFS_BLOCK_SIZE;
-    for (int i = 0; i < numBlocks; ++i) {
-        unsigned int blockNum = entryInode->direct[i];
-        if (blockNum != 0) {
-            int dataBlockIndex = blockNum - super.data_region_addr;
-            dataBitmap[dataBlockIndex / 8] &= ~(1 << (dataBlockIndex % 8));
-            entryInode->direct[i] = 0;
-        }
-    }
-
-    entryInode->size = 0;
-
-    // Remove directory entry
-    dirEntries[entryIndex].name[0] = '\0';  // Mark as unused
-
-    // Check if the block containing the entry is now empty
-    int blockIndex = entryIndex / maxEntriesPerBlock;
-    bool blockEmpty = true;
-    for (int i = 0; i < maxEntriesPerBlock; ++i) {
-        if (dirEntries[blockIndex * maxEntriesPerBlock + i].name[0] != '\0') {
-            blockEmpty = false;
-            break;
-        }
-    }
-
-    // If block is empty, free it
-    if (blockEmpty) {
-        unsigned int blockNum = inodes[parentInodeNumber].direct[blockIndex];
-        int dataBlockIndex = blockNum - super.data_region_addr;
-        dataBitmap[dataBlockIndex / 8] &= ~(1 << (dataBlockIndex % 8));
-        inodes[parentInodeNumber].direct[blockIndex] = 0;
-        inodes[parentInodeNumber].size -= UFS_BLOCK_SIZE;
-    }
-
-    // Write updated directory data back to disk
-    for (int i = 0; i < totalBlocks; ++i) {
-        unsigned int blockNum = inodes[parentInodeNumber].direct[i];
-        if (blockNum != 0) {
-            disk->writeBlock(blockNum, &dirEntries[i * maxEntriesPerBlock]);
-        }
-    }
+    bool refcountsChanged = releaseInode(&super, inodeBitmap, dataBitmap, refcounts, inodes, entryInodeNumber);
+    removeDirectoryEntry(&super, parentInode, dataBitmap, name);
 
     // Write updates to disk
     writeInodeBitmap(&super, inodeBitmap);
     writeDataBitmap(&super, dataBitmap);
+    if (refcountsChanged) {
+        writeRefcounts(&super, refcounts);
+    }
     writeInodeRegion(&super, inodes);
 
+    delete[] refcounts;
     delete[] dataBitmap;
-    delete[] dirData;
     delete[] inodeBitmap;
     delete[] inodes;
 
@@ -845,20 +2033,133 @@ int LocalFileSystem::unlink(int parentInodeNumber, std::string name) {
 }
 
 
+int LocalFileSystem::rename(int srcParentInodeNumber, std::string srcName,
+                            int dstParentInodeNumber, std::string dstName) {
+    TraceSpan span("rename");
+    super_t super;
+    readSuperBlock(&super);
+
+    // Validate both names; '.' and '..' are structural and never move
+    bool longNames = (super.features & UFS_FEATURE_LONG_NAMES) != 0;
+    int maxNameLength = longNames ? DIR_REC_MAX_NAME_LEN : DIR_ENT_NAME_SIZE - 1;
+    std::string names[] = {srcName, dstName};
+    for (const std::string &name : names) {
+        if (name == "." || name == ".." || name.empty() || (int) name.length() > maxNameLength) {
+            return -EINVALIDNAME;
+        }
+    }
+
+    int inodeBitmapSize = (super.num_inodes + 7) / 8;
+    unsigned char *inodeBitmap = new unsigned char[inodeBitmapSize];
+    readInodeBitmap(&super, inodeBitmap);
 
+    unsigned char *dataBitmap = new unsigned char[super.data_bitmap_len * UFS_BLOCK_SIZE];
+    readDataBitmap(&super, dataBitmap);
 
+    unsigned int *refcounts = loadRefcounts(&super);
 
+    inode_t *inodes = new inode_t[super.num_inodes];
+    readInodeRegion(&super, inodes);
 
+    // Everything is checked before the first write, so a failed rename
+    // leaves the file system as it was.
+    int result = 0;
+    int srcInodeNumber = -1;
+    int dstInodeNumber = -1;
+    int parents[] = {srcParentInodeNumber, dstParentInodeNumber};
+    for (int parent : parents) {
+        if (parent < 0 || parent >= super.num_inodes ||
+            !(inodeBitmap[parent / 8] & (1 << (parent % 8))) ||
+            inodes[parent].type != UFS_DIRECTORY) {
+            result = -EINVALIDINODE;
+        }
+    }
 
+    if (result == 0) {
+        srcInodeNumber = findDirectoryEntry(&super, &inodes[srcParentInodeNumber], srcName);
+        if (srcInodeNumber == -ENOTFOUND) {
+            result = -ENOTFOUND;
+        } else if (srcInodeNumber < 0 || srcInodeNumber >= super.num_inodes ||
+                   !(inodeBitmap[srcInodeNumber / 8] & (1 << (srcInodeNumber % 8)))) {
+            result = -EINVALIDINODE;
+        }
+    }
 
+    if (result == 0) {
+        dstInodeNumber = findDirectoryEntry(&super, &inodes[dstParentInodeNumber], dstName);
+        if (dstInodeNumber == srcInodeNumber) {
+            // Renaming something onto itself is a no-op
+            delete[] inodeBitmap;
+            delete[] dataBitmap;
+            delete[] refcounts;
+            delete[] inodes;
+            return 0;
+        }
+    }
 
+    bool isDirectory = result == 0 && inodes[srcInodeNumber].type == UFS_DIRECTORY;
+    if (isDirectory) {
+        // A directory can't move underneath itself; walk up from the
+        // destination to the root through '..' looking for it.
+        int current = dstParentInodeNumber;
+        for (int steps = 0; steps < super.num_inodes && current != UFS_ROOT_DIRECTORY_INODE_NUMBER; steps++) {
+            if (current == srcInodeNumber) {
+                result = -EINVALIDMOVE;
+                break;
+            }
+            current = findDirectoryEntry(&super, &inodes[current], "..");
+            if (current < 0 || current >= super.num_inodes) {
+                break;
+            }
+        }
+    }
 
+    if (result == 0 && dstInodeNumber >= 0) {
+        // An existing destination is replaced, as long as it is the same kind
+        // of thing and, for a directory, empty.
+        std::vector<DirectoryEntry> dstEntries;
+        if (dstInodeNumber >= super.num_inodes ||
+            !(inodeBitmap[dstInodeNumber / 8] & (1 << (dstInodeNumber % 8)))) {
+            result = -EINVALIDINODE;
+        } else if (inodes[dstInodeNumber].type != inodes[srcInodeNumber].type) {
+            result = -EINVALIDTYPE;
+        } else if (isDirectory && listDirectory(&super, &inodes[dstInodeNumber], dstEntries) > 2) {
+            result = -EDIRNOTEMPTY;
+        }
+    }
 
+    bool refcountsChanged = false;
+    if (result == 0) {
+        if (dstInodeNumber >= 0) {
+            replaceDirectoryEntry(&super, &inodes[dstParentInodeNumber], dstName, srcInodeNumber);
+            refcountsChanged = releaseInode(&super, inodeBitmap, dataBitmap, refcounts, inodes, dstInodeNumber);
+        } else {
+            // The only step that can run out of room, and it writes nothing
+            // when it does
+            result = addDirectoryEntry(&super, &inodes[dstParentInodeNumber], dataBitmap, dstName, srcInodeNumber);
+        }
+    }
 
+    if (result == 0) {
+        removeDirectoryEntry(&super, &inodes[srcParentInodeNumber], dataBitmap, srcName);
+        if (isDirectory && srcParentInodeNumber != dstParentInodeNumber) {
+            replaceDirectoryEntry(&super, &inodes[srcInodeNumber], "..", dstParentInodeNumber);
+        }
 
+        // The file's data never moves, only the entries that name it
+        writeInodeBitmap(&super, inodeBitmap);
+        writeDataBitmap(&super, dataBitmap);
+        if (refcountsChanged) {
+            writeRefcounts(&super, refcounts);
+        }
+        writeInodeRegion(&super, inodes);
+    }
 
+    // Clean up
+    delete[] inodeBitmap;
+    delete[] dataBitmap;
+    delete[] refcounts;
+    delete[] inodes;
 
-        /* Stop if we’ve written all data
-        if (blockOffset + writeSize >= size) {
-            break;
-        }*/
\ No newline at end of file
+    return result;
+}
@@ -0,0 +1,226 @@
+#include "Log.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define RING_SIZE (64 * 1024)
+#define MAX_LINE 1024
+#define FLUSH_INTERVAL_MS 10
+
+struct RecordHeader {
+  uint64_t seq;
+  uint32_t len;
+};
+
+// One per thread that has logged. Only that thread moves head and only the
+// flusher moves tail; both count bytes ever written, so head - tail is how
+// much is waiting.
+struct ThreadLog {
+  char ring[RING_SIZE];
+  atomic<size_t> head;
+  atomic<size_t> tail;
+  size_t drained;  // the flusher's note of how far its batch went
+  int tid;
+  char line[MAX_LINE];
+  ThreadLog *next;
+};
+
+struct PendingLine {
+  uint64_t seq;
+  ThreadLog *thread;
+  size_t pos;
+  uint32_t len;
+};
+
+static int logFd = -1;
+static bool enabled = false;
+// Pushed onto and never removed from, so the flusher can walk it lock-free
+static atomic<ThreadLog *> threads(NULL);
+static atomic<int> nextTid(0);
+static atomic<uint64_t> nextSeq(0);
+static thread_local ThreadLog *self = NULL;
+
+static pthread_mutex_t flushLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flushWanted = PTHREAD_COND_INITIALIZER;
+
+static ThreadLog *threadLog() {
+  if (self == NULL) {
+    self = new ThreadLog();
+    self->head.store(0);
+    self->tail.store(0);
+    self->tid = nextTid.fetch_add(1);
+    ThreadLog *first = threads.load();
+    do {
+      self->next = first;
+    } while (!threads.compare_exchange_weak(first, self));
+  }
+  return self;
+}
+
+static void copyIn(ThreadLog *thread, size_t pos, const void *data, size_t len) {
+  size_t offset = pos % RING_SIZE;
+  size_t first = min(len, (size_t) RING_SIZE - offset);
+  memcpy(thread->ring + offset, data, first);
+  memcpy(thread->ring, (const char *) data + first, len - first);
+}
+
+static void copyOut(ThreadLog *thread, size_t pos, void *data, size_t len) {
+  size_t offset = pos % RING_SIZE;
+  size_t first = min(len, (size_t) RING_SIZE - offset);
+  memcpy(data, thread->ring + offset, first);
+  memcpy((char *) data + first, thread->ring, len - first);
+}
+
+// Writes everything the rings held when it started. Callers hold flushLock,
+// so there is one consumer at a time.
+static void drain() {
+  // Never destroyed, since the flush at exit may run after static destructors
+  static vector<PendingLine> &pending = *new vector<PendingLine>();
+  static string &batch = *new string();
+  pending.clear();
+  batch.clear();
+
+  for (ThreadLog *thread = threads.load(); thread != NULL; thread = thread->next) {
+    size_t head = thread->head.load(memory_order_acquire);
+    size_t pos = thread->tail.load(memory_order_relaxed);
+    while (pos < head) {
+      RecordHeader header;
+      copyOut(thread, pos, &header, sizeof(header));
+      PendingLine line = {header.seq, thread, pos + sizeof(header), header.len};
+      pending.push_back(line);
+      pos += sizeof(header) + header.len;
+    }
+    thread->drained = head;
+  }
+
+  sort(pending.begin(), pending.end(),
+       [](const PendingLine &a, const PendingLine &b) { return a.seq < b.seq; });
+  for (const PendingLine &line : pending) {
+    size_t at = batch.size();
+    batch.resize(at + line.len);
+    copyOut(line.thread, line.pos, &batch[at], line.len);
+  }
+
+  const char *data = batch.data();
+  size_t len = batch.size();
+  while (len > 0) {
+    ssize_t ret = ::write(logFd, data, len);
+    if (ret <= 0) {
+      cerr << "log file write error, ret = " << ret << " expected " << len << endl;
+      enabled = false;  // so the flush at exit doesn't wait on flushLock
+      exit(1);
+    }
+    data += ret;
+    len -= ret;
+  }
+
+  for (ThreadLog *thread = threads.load(); thread != NULL; thread = thread->next) {
+    thread->tail.store(thread->drained, memory_order_release);
+  }
+}
+
+static void *flushLoop(void *) {
+  pthread_mutex_lock(&flushLock);
+  while (true) {
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_nsec += FLUSH_INTERVAL_MS * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&flushWanted, &flushLock, &deadline);
+    drain();
+  }
+  return NULL;
+}
+
+void Log::open(const string &file) {
+  logFd = ::open(file.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (logFd < 0) {
+    cerr << "Could not open log file: " << file << endl;
+    exit(1);
+  }
+  if (file == "/dev/null") {
+    return;
+  }
+
+  enabled = true;
+  atexit(Log::flush);
+  pthread_t flusher;
+  pthread_create(&flusher, NULL, flushLoop, NULL);
+  pthread_detach(flusher);
+}
+
+// line holds len bytes, ending in a newline
+static void append(ThreadLog *thread, size_t len) {
+  size_t need = sizeof(RecordHeader) + len;
+  size_t head = thread->head.load(memory_order_relaxed);
+  while (RING_SIZE - (head - thread->tail.load(memory_order_acquire)) < need) {
+    pthread_cond_signal(&flushWanted);
+    usleep(100);
+  }
+
+  // Numbered once there is room, so waiting doesn't put the line out of order
+  RecordHeader header = {nextSeq.fetch_add(1, memory_order_relaxed), (uint32_t) len};
+  copyIn(thread, head, &header, sizeof(header));
+  copyIn(thread, head + sizeof(header), thread->line, len);
+  thread->head.store(head + need, memory_order_release);
+
+  if (head + need - thread->tail.load(memory_order_relaxed) > RING_SIZE / 2) {
+    pthread_cond_signal(&flushWanted);
+  }
+}
+
+void Log::write(const char *event, const char *format, ...) {
+  if (!enabled) {
+    return;
+  }
+  ThreadLog *thread = threadLog();
+  size_t len = snprintf(thread->line, MAX_LINE, "%s thread: %d ", event, thread->tid);
+  if (len < MAX_LINE - 1) {
+    va_list args;
+    va_start(args, format);
+    int payload = vsnprintf(thread->line + len, MAX_LINE - 1 - len, format, args);
+    va_end(args);
+    if (payload > 0) {
+      len += payload;
+    }
+  }
+  // Long lines are cut short, leaving room for the newline
+  len = min(len, (size_t) MAX_LINE - 2);
+  thread->line[len++] = '\n';
+  append(thread, len);
+}
+
+void Log::write(const char *event) {
+  Log::write(event, "%s", "");
+}
+
+void Log::flush() {
+  if (!enabled) {
+    return;
+  }
+  pthread_mutex_lock(&flushLock);
+  drain();
+  pthread_mutex_unlock(&flushLock);
+}
+
+int Log::threadId() {
+  return threadLog()->tid;
+}
@@ -0,0 +1,199 @@
+#include "Metrics.h"
+
+#include <atomic>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+
+using namespace std;
+
+#define MAX_ROUTES 8
+// Eight buckets for each power of two: 0-7us one each, then 8-9, 10-11,
+// ... 14-15, 16-19 and so on, up to 2^33us (a couple of hours)
+#define SUB_BUCKET_BITS 3
+#define SUB_BUCKETS (1 << SUB_BUCKET_BITS)
+#define MAX_POWER 33
+#define NUM_BUCKETS ((MAX_POWER - SUB_BUCKET_BITS + 2) * SUB_BUCKETS)
+
+static const char *counterNames[Metrics::NUM_COUNTERS][2] = {
+  {"gunrock_bytes_in_total", "Request bytes read from clients"},
+  {"gunrock_bytes_out_total", "Response bytes written to clients"},
+  {"gunrock_block_reads_total", "Disk blocks read"},
+  {"gunrock_block_writes_total", "Disk blocks written"},
+  {"gunrock_fsyncs_total", "fsync calls on the disk image"},
+  {"gunrock_disk_syscalls_total", "System calls made on the disk image"},
+};
+
+static const char *methodNames[Metrics::NUM_METHODS] = {
+  "HEAD", "GET", "PUT", "POST", "DELETE", "MOVE", "OTHER"
+};
+
+struct Histogram {
+  atomic<unsigned long long> buckets[NUM_BUCKETS];
+  atomic<unsigned long long> sum;
+};
+
+// One per thread that has recorded anything. Only its thread adds to it;
+// render() reads it. Never freed, so a thread's counts outlive it.
+struct Shard {
+  atomic<unsigned long long> counters[Metrics::NUM_COUNTERS];
+  Histogram latency[MAX_ROUTES][Metrics::NUM_METHODS];
+  Shard *next;
+};
+
+struct Source {
+  string name;
+  string help;
+  function<unsigned long long()> value;
+};
+
+static atomic<Shard *> shards(NULL);
+static thread_local Shard *self = NULL;
+static vector<string> routes;
+static vector<Source> sources;
+
+static Shard *shard() {
+  if (self == NULL) {
+    self = new Shard();  // value-initialized: all zero
+    Shard *first = shards.load();
+    do {
+      self->next = first;
+    } while (!shards.compare_exchange_weak(first, self));
+  }
+  return self;
+}
+
+static int bucketFor(unsigned long long micros) {
+  if (micros < SUB_BUCKETS) {
+    return micros;
+  }
+  int power = 63 - __builtin_clzll(micros);
+  if (power > MAX_POWER) {
+    return NUM_BUCKETS - 1;
+  }
+  int sub = (micros >> (power - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+  return (power - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+}
+
+// The smallest latency that lands in bucket
+static unsigned long long bucketStart(int bucket) {
+  if (bucket < SUB_BUCKETS) {
+    return bucket;
+  }
+  int power = bucket / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+  unsigned long long sub = bucket % SUB_BUCKETS;
+  return (SUB_BUCKETS + sub) << (power - SUB_BUCKET_BITS);
+}
+
+void Metrics::count(Counter counter, unsigned long long n) {
+  shard()->counters[counter].fetch_add(n, memory_order_relaxed);
+}
+
+unsigned long long Metrics::total(Counter counter) {
+  unsigned long long total = 0;
+  for (Shard *s = shards.load(); s != NULL; s = s->next) {
+    total += s->counters[counter].load(memory_order_relaxed);
+  }
+  return total;
+}
+
+const char *Metrics::methodName(Method method) {
+  return methodNames[method];
+}
+
+int Metrics::addRoute(const string &name) {
+  assert(routes.size() < MAX_ROUTES);
+  routes.push_back(name);
+  return routes.size() - 1;
+}
+
+void Metrics::recordLatency(int route, Method method, unsigned long long micros) {
+  Histogram &histogram = shard()->latency[route][method];
+  histogram.buckets[bucketFor(micros)].fetch_add(1, memory_order_relaxed);
+  histogram.sum.fetch_add(micros, memory_order_relaxed);
+}
+
+void Metrics::addCounter(const string &name, const string &help,
+                         function<unsigned long long()> value) {
+  Source source = {name, help, value};
+  sources.push_back(source);
+}
+
+static string seconds(unsigned long long micros) {
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%g", micros / 1e6);
+  return buf;
+}
+
+string Metrics::render() {
+  stringstream out;
+
+  for (int idx = 0; idx < NUM_COUNTERS; idx++) {
+    out << "# HELP " << counterNames[idx][0] << " " << counterNames[idx][1] << "\n";
+    out << "# TYPE " << counterNames[idx][0] << " counter\n";
+    out << counterNames[idx][0] << " " << total((Counter) idx) << "\n";
+  }
+  for (Source &source : sources) {
+    out << "# HELP " << source.name << " " << source.help << "\n";
+    out << "# TYPE " << source.name << " counter\n";
+    out << source.name << " " << source.value() << "\n";
+  }
+
+  // Exported with a bucket per power of two; the finer buckets go into
+  // the quantiles
+  out << "# HELP gunrock_request_duration_seconds Time from a parsed request to its response being sent\n";
+  out << "# TYPE gunrock_request_duration_seconds histogram\n";
+  stringstream quantiles;
+  quantiles << "# HELP gunrock_request_duration_quantile_seconds Request duration quantiles, to within an eighth\n";
+  quantiles << "# TYPE gunrock_request_duration_quantile_seconds gauge\n";
+  for (size_t route = 0; route < routes.size(); route++) {
+    for (int method = 0; method < NUM_METHODS; method++) {
+      unsigned long long buckets[NUM_BUCKETS] = {0};
+      unsigned long long count = 0, sum = 0;
+      for (Shard *s = shards.load(); s != NULL; s = s->next) {
+        Histogram &histogram = s->latency[route][method];
+        for (int bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+          unsigned long long n = histogram.buckets[bucket].load(memory_order_relaxed);
+          buckets[bucket] += n;
+          count += n;
+        }
+        sum += histogram.sum.load(memory_order_relaxed);
+      }
+      if (count == 0) {
+        continue;
+      }
+
+      string labels = "route=\"" + routes[route] + "\",method=\"" + methodNames[method] + "\"";
+      unsigned long long below = 0;
+      for (int bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+        below += buckets[bucket];
+        if ((bucket + 1) % SUB_BUCKETS == 0 && bucket + 1 < NUM_BUCKETS) {
+          out << "gunrock_request_duration_seconds_bucket{" << labels << ",le=\""
+              << seconds(bucketStart(bucket + 1)) << "\"} " << below << "\n";
+        }
+      }
+      out << "gunrock_request_duration_seconds_bucket{" << labels << ",le=\"+Inf\"} " << count << "\n";
+      out << "gunrock_request_duration_seconds_sum{" << labels << "} " << seconds(sum) << "\n";
+      out << "gunrock_request_duration_seconds_count{" << labels << "} " << count << "\n";
+
+      const double wanted[] = {0.5, 0.9, 0.99, 0.999};
+      for (double quantile : wanted) {
+        unsigned long long rank = (unsigned long long) (quantile * count), seen = 0;
+        int bucket = 0;
+        while (bucket < NUM_BUCKETS - 1 && seen + buckets[bucket] <= rank) {
+          seen += buckets[bucket++];
+        }
+        // The top of the bucket the quantile falls in
+        quantiles << "gunrock_request_duration_quantile_seconds{" << labels << ",quantile=\""
+                  << quantile << "\"} " << seconds(bucketStart(bucket + 1)) << "\n";
+      }
+    }
+  }
+
+  out << quantiles.str();
+  return out.str();
+}
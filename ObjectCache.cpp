@@ -0,0 +1,75 @@
+#include "ObjectCache.h"
+
+using namespace std;
+
+ObjectCache::ObjectCache(size_t capacity) {
+  m_capacity = capacity;
+  m_bytes = 0;
+  m_hits = 0;
+  m_misses = 0;
+  m_evictions = 0;
+}
+
+const CachedObject *ObjectCache::get(const string &path) {
+  map<string, Entry>::iterator it = m_entries.find(path);
+  if (it == m_entries.end()) {
+    m_misses++;
+    return NULL;
+  }
+
+  m_hits++;
+  m_lru.splice(m_lru.begin(), m_lru, it->second.lru);
+  return &it->second.object;
+}
+
+void ObjectCache::put(const string &path, const CachedObject &object) {
+  map<string, Entry>::iterator it = m_entries.find(path);
+  if (it != m_entries.end()) {
+    erase(it);
+  }
+  if (object.body.size() > m_capacity / 8) {
+    return;
+  }
+
+  while (m_bytes + object.body.size() > m_capacity && !m_lru.empty()) {
+    erase(m_entries.find(m_lru.back()));
+    m_evictions++;
+  }
+
+  m_lru.push_front(path);
+  Entry &entry = m_entries[path];
+  entry.object = object;
+  entry.lru = m_lru.begin();
+  m_bytes += object.body.size();
+}
+
+void ObjectCache::invalidate(const string &path) {
+  map<string, Entry>::iterator it = m_entries.find(path);
+  if (it != m_entries.end()) {
+    erase(it);
+  }
+
+  // Everything under path sorts between "path/" and "path0" ('0' follows '/')
+  string base = path == "/" ? "" : path;
+  it = m_entries.lower_bound(base + "/");
+  while (it != m_entries.end() && it->first.compare(0, base.size() + 1, base + "/") == 0) {
+    erase(it++);
+  }
+
+  // Creating or removing an entry changes the listings above it
+  string ancestor = path;
+  while (ancestor != "/") {
+    size_t slash = ancestor.rfind('/');
+    ancestor = slash == 0 ? "/" : ancestor.substr(0, slash);
+    it = m_entries.find(ancestor);
+    if (it != m_entries.end()) {
+      erase(it);
+    }
+  }
+}
+
+void ObjectCache::erase(map<string, Entry>::iterator it) {
+  m_bytes -= it->second.object.body.size();
+  m_lru.erase(it->second.lru);
+  m_entries.erase(it);
+}
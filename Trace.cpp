@@ -0,0 +1,151 @@
+#include "Trace.h"
+
+#include <deque>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+using namespace std;
+
+#define KEPT_TRACES 64
+
+struct Span {
+  const char *name;
+  long long start;
+  long long end;
+  string args;
+};
+
+struct TraceBuffer {
+  int id;
+  vector<Span> spans;
+};
+
+static thread_local TraceBuffer *current = NULL;
+
+// Finished traces, as JSON events, oldest first
+static pthread_mutex_t keptLock = PTHREAD_MUTEX_INITIALIZER;
+static map<int, string> kept;
+static deque<int> keptOrder;
+static int nextId = 1;
+
+static string escape(const string &value) {
+  string escaped;
+  for (char c : value) {
+    if (c == '"' || c == '\\') {
+      escaped += '\\';
+      escaped += c;
+    } else if ((unsigned char) c < 0x20) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      escaped += buf;
+    } else {
+      escaped += c;
+    }
+  }
+  return escaped;
+}
+
+int Trace::start() {
+  pthread_mutex_lock(&keptLock);
+  int id = nextId++;
+  pthread_mutex_unlock(&keptLock);
+
+  delete current;
+  current = new TraceBuffer();
+  current->id = id;
+  current->spans.reserve(64);
+  return id;
+}
+
+void Trace::finish() {
+  if (current == NULL) {
+    return;
+  }
+
+  // Complete ("X") events on a row of their own, which the viewer nests
+  // by time
+  stringstream events;
+  for (size_t idx = 0; idx < current->spans.size(); idx++) {
+    const Span &span = current->spans[idx];
+    events << (idx > 0 ? ",\n" : "")
+           << "{\"name\":\"" << span.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << current->id
+           << ",\"ts\":" << span.start << ",\"dur\":" << span.end - span.start
+           << ",\"args\":{" << span.args << "}}";
+  }
+
+  pthread_mutex_lock(&keptLock);
+  kept[current->id] = events.str();
+  keptOrder.push_back(current->id);
+  if (keptOrder.size() > KEPT_TRACES) {
+    kept.erase(keptOrder.front());
+    keptOrder.pop_front();
+  }
+  pthread_mutex_unlock(&keptLock);
+
+  delete current;
+  current = NULL;
+}
+
+bool Trace::active() {
+  return current != NULL;
+}
+
+long long Trace::now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000LL + now.tv_nsec / 1000;
+}
+
+void Trace::addSpan(const char *name, long long start, long long end, const string &args) {
+  if (current == NULL) {
+    return;
+  }
+  Span span = {name, start, end, args};
+  current->spans.push_back(span);
+}
+
+string Trace::json(int id) {
+  string events;
+  pthread_mutex_lock(&keptLock);
+  if (id >= 0) {
+    if (kept.count(id) == 0) {
+      pthread_mutex_unlock(&keptLock);
+      return "";
+    }
+    events = kept[id];
+  } else {
+    for (int keptId : keptOrder) {
+      if (!kept[keptId].empty()) {
+        events += (events.empty() ? "" : ",\n") + kept[keptId];
+      }
+    }
+  }
+  pthread_mutex_unlock(&keptLock);
+  return "{\"traceEvents\":[\n" + events + "\n]}\n";
+}
+
+string Trace::arg(const char *key, const string &value) {
+  return "\"" + string(key) + "\":\"" + escape(value) + "\"";
+}
+
+string Trace::arg(const char *key, long long value) {
+  return "\"" + string(key) + "\":" + to_string(value);
+}
+
+void TraceSpan::arg(const char *key, const string &value) {
+  if (m_active) {
+    m_args += (m_args.empty() ? "" : ",") + Trace::arg(key, value);
+  }
+}
+
+void TraceSpan::arg(const char *key, long long value) {
+  if (m_active) {
+    m_args += (m_args.empty() ? "" : ",") + Trace::arg(key, value);
+  }
+}
@@ -0,0 +1,27 @@
+#include <stdlib.h>
+
+#include "TraceService.h"
+#include "ClientError.h"
+#include "Trace.h"
+
+using namespace std;
+
+TraceService::TraceService() : HttpService("/traces") {
+}
+
+void TraceService::get(HTTPRequest *request, HTTPResponse *response) {
+  vector<string> components = request->getPathComponents();
+  // "traces" and maybe an id
+  string json;
+  if (components.size() < 2) {
+    json = Trace::json(-1);
+  } else {
+    char *end;
+    long id = strtol(components[1].c_str(), &end, 10);
+    if (*end != '\0' || id < 0 || (json = Trace::json(id)).empty()) {
+      throw ClientError::notFound();
+    }
+  }
+  response->setContentType("application/json");
+  response->setBody(json);
+}
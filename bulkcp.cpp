@@ -0,0 +1,332 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "HttpClient.h"
+#include "HTTPClientResponse.h"
+
+using namespace std;
+
+// bulkcp: copies a local directory tree to gunrock_web (put) or a tree on
+// gunrock_web to a local directory (get), over -c connections at once.
+// Each connection writes up to -d requests before reading their responses
+// once the server has shown it keeps connections open; gunrock_web closes
+// every connection, so against it each connection has one request out at
+// a time. Files to upload are mmap'd and written from the mapping. Prints
+// the files, bytes and throughput at the end.
+
+struct Task {
+  string local;
+  string remote;     // under /ds3
+  bool directory;    // get: a listing to expand
+  long long size;    // put: the bytes to send
+  int attempts;
+};
+
+string HOST = "localhost";
+int PORT = 8080;
+int CONNECTIONS = 4;
+int DEPTH = 8;
+const int MAX_ATTEMPTS = 3;
+
+static bool upload;
+static deque<Task> tasks;
+static int busy = 0;  // workers holding tasks, which may add more
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t changed = PTHREAD_COND_INITIALIZER;
+
+struct Worker {
+  long files;
+  long requests;
+  long long bytes;
+  long failures;
+};
+
+// Up to max tasks into batch; false once there are none left and no worker
+// can add any
+static bool takeTasks(vector<Task> &batch, int max) {
+  pthread_mutex_lock(&lock);
+  while (tasks.empty() && busy > 0) {
+    pthread_cond_wait(&changed, &lock);
+  }
+  while (!tasks.empty() && (int) batch.size() < max) {
+    batch.push_back(tasks.front());
+    tasks.pop_front();
+  }
+  bool took = !batch.empty();
+  if (took) {
+    busy++;
+  }
+  pthread_mutex_unlock(&lock);
+  return took;
+}
+
+// Hands back the tasks of a batch that weren't answered, first, and the
+// ones its listings turned up
+static void finishTasks(const vector<Task> &retry, const vector<Task> &found) {
+  pthread_mutex_lock(&lock);
+  tasks.insert(tasks.begin(), retry.begin(), retry.end());
+  tasks.insert(tasks.end(), found.begin(), found.end());
+  busy--;
+  pthread_cond_broadcast(&changed);
+  pthread_mutex_unlock(&lock);
+}
+
+static void fail(Worker *worker, const string &what) {
+  pthread_mutex_lock(&lock);
+  cerr << "bulkcp: " << what << endl;
+  pthread_mutex_unlock(&lock);
+  worker->failures++;
+}
+
+// Writes the request for task without waiting for the response. False if
+// there was nothing to send because the local file couldn't be read.
+static bool sendTask(HttpClient *client, const Task &task, Worker *worker) {
+  if (!upload) {
+    client->write_request("/ds3" + task.remote + (task.directory ? "/" : ""), "GET", "");
+    return true;
+  }
+
+  int fd = open(task.local.c_str(), O_RDONLY);
+  void *data = NULL;
+  if (fd >= 0 && task.size > 0) {
+    data = mmap(NULL, task.size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  if (fd < 0 || data == MAP_FAILED) {
+    fail(worker, "could not read " + task.local);
+    return false;
+  }
+  madvise(data, task.size, MADV_SEQUENTIAL);
+
+  try {
+    client->write_request("/ds3" + task.remote, "PUT", (const char *) data, task.size);
+  } catch (...) {
+    munmap(data, task.size);
+    throw;
+  }
+  munmap(data, task.size);
+  return true;
+}
+
+// Acts on the response to task: saves a downloaded file, or queues the
+// entries of a downloaded listing in found
+static void finishTask(const Task &task, HTTPClientResponse *response, vector<Task> &found,
+                       Worker *worker) {
+  if (response->status() != 200) {
+    stringstream what;
+    what << (upload ? "PUT " : "GET ") << task.remote << ": " << response->status();
+    fail(worker, what.str());
+    return;
+  }
+  worker->files += task.directory ? 0 : 1;
+  if (upload) {
+    worker->bytes += task.size;
+    return;
+  }
+
+  string body = response->body();
+  if (task.directory) {
+    stringstream listing(body);
+    string name;
+    while (getline(listing, name)) {
+      Task entry = {task.local + "/" + name, task.remote + "/" + name, false, 0, 0};
+      if (!name.empty() && name.back() == '/') {
+        entry.local.pop_back();
+        entry.remote.pop_back();
+        entry.directory = true;
+        mkdir(entry.local.c_str(), 0755);
+      }
+      found.push_back(entry);
+    }
+    return;
+  }
+
+  int fd = open(task.local.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0 || write(fd, body.data(), body.size()) != (ssize_t) body.size()) {
+    fail(worker, "could not write " + task.local);
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  worker->bytes += body.size();
+}
+
+static void *runWorker(void *arg) {
+  Worker *worker = (Worker *) arg;
+  HttpClient *client = NULL;
+  bool pipeline = false;  // the last response kept the connection open
+  vector<Task> batch;
+  while (takeTasks(batch, pipeline ? DEPTH : 1)) {
+    vector<Task> retry, found;
+    vector<Task *> inflight;
+    size_t next = 0, answered = 0;
+    bool broken = false;
+    try {
+      if (client == NULL) {
+        client = new HttpClient(HOST.c_str(), PORT);
+      }
+      for (; next < batch.size(); next++) {
+        if (sendTask(client, batch[next], worker)) {
+          inflight.push_back(&batch[next]);
+          worker->requests++;
+        }
+      }
+      while (answered < inflight.size()) {
+        HTTPClientResponse *response = client->read_response();
+        if (response->status() == 0) {
+          delete response;
+          broken = true;
+          break;
+        }
+        finishTask(*inflight[answered++], response, found, worker);
+        pipeline = response->keepAlive();
+        delete response;
+        if (!pipeline) {
+          break;
+        }
+      }
+    } catch (runtime_error &) {
+      broken = true;  // could not connect, or the connection went away
+    }
+    if (broken) {
+      delete client;
+      client = NULL;
+      pipeline = false;
+    }
+
+    // What got no answer goes out again, on this connection or a new one.
+    // Only a broken connection counts against a task: a server may close
+    // a connection with pipelined requests still unread.
+    vector<Task *> unanswered(inflight.begin() + answered, inflight.end());
+    for (size_t idx = next; idx < batch.size(); idx++) {
+      unanswered.push_back(&batch[idx]);
+    }
+    for (Task *task : unanswered) {
+      if (!broken || ++task->attempts < MAX_ATTEMPTS) {
+        retry.push_back(*task);
+      } else {
+        fail(worker, task->remote + ": no response");
+      }
+    }
+    finishTasks(retry, found);
+    batch.clear();
+  }
+  delete client;
+  return NULL;
+}
+
+static string localRoot;
+static string remoteRoot;
+
+static int addFile(const char *path, const struct stat *st, int type, struct FTW *ftw) {
+  if (type == FTW_F && S_ISREG(st->st_mode)) {
+    Task task = {path, remoteRoot + string(path).substr(localRoot.size()), false, st->st_size, 0};
+    tasks.push_back(task);
+  }
+  return 0;
+}
+
+static string trimSlashes(string path) {
+  while (path.size() > 1 && path.back() == '/') {
+    path.pop_back();
+  }
+  return path;
+}
+
+static void usage(const char *name) {
+  cerr << "usage: " << name << " [-h host] [-p port] [-c connections] [-d depth]"
+       << " put localDir remoteDir | get remoteDir localDir" << endl;
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  int option;
+  while ((option = getopt(argc, argv, "h:p:c:d:")) != -1) {
+    switch (option) {
+    case 'h':
+      HOST = optarg;
+      break;
+    case 'p':
+      PORT = atoi(optarg);
+      break;
+    case 'c':
+      CONNECTIONS = atoi(optarg);
+      break;
+    case 'd':
+      DEPTH = atoi(optarg);
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (argc - optind != 3 || CONNECTIONS <= 0 || DEPTH <= 0) {
+    usage(argv[0]);
+  }
+
+  string command = argv[optind];
+  if (command == "put") {
+    upload = true;
+    localRoot = trimSlashes(argv[optind + 1]);
+    remoteRoot = trimSlashes(argv[optind + 2]);
+  } else if (command == "get") {
+    upload = false;
+    remoteRoot = trimSlashes(argv[optind + 1]);
+    localRoot = trimSlashes(argv[optind + 2]);
+  } else {
+    usage(argv[0]);
+  }
+  if (remoteRoot == "/") {
+    remoteRoot = "";
+  } else if (remoteRoot[0] != '/') {
+    remoteRoot = "/" + remoteRoot;
+  }
+
+  if (upload) {
+    if (nftw(localRoot.c_str(), addFile, 64, FTW_PHYS) != 0) {
+      cerr << "bulkcp: could not read " << localRoot << endl;
+      return 1;
+    }
+  } else {
+    mkdir(localRoot.c_str(), 0755);
+    Task root = {localRoot, remoteRoot, true, 0, 0};
+    tasks.push_back(root);
+  }
+
+  vector<Worker> workers(CONNECTIONS, Worker{0, 0, 0, 0});
+  vector<pthread_t> threads(CONNECTIONS);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  for (int idx = 0; idx < CONNECTIONS; idx++) {
+    pthread_create(&threads[idx], NULL, runWorker, &workers[idx]);
+  }
+  for (int idx = 0; idx < CONNECTIONS; idx++) {
+    pthread_join(threads[idx], NULL);
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  Worker total = {0, 0, 0, 0};
+  for (Worker &worker : workers) {
+    total.files += worker.files;
+    total.requests += worker.requests;
+    total.bytes += worker.bytes;
+    total.failures += worker.failures;
+  }
+  printf("%ld files, %lld bytes, %ld requests in %.2f s: %.2f MB/s, %.1f files/sec, %ld failed\n",
+         total.files, total.bytes, total.requests, seconds, total.bytes / seconds / (1 << 20),
+         total.files / seconds, total.failures);
+  return total.failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,182 @@
+#include <algorithm>
+#include <chrono>
+#include <functional>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <stdio.h>
+
+#include "LocalFileSystem.h"
+#include "Disk.h"
+#include "Metrics.h"
+#include "ufs.h"
+
+using namespace std;
+
+// ds3bench <image>: times LocalFileSystem lookup, stat, create, write and
+// read on a freshly made image, over a range of directory sizes, path
+// depths and file sizes. One line per case: ops/sec, mean and p99 latency,
+// and the block reads, block writes, system calls and bytes of disk I/O
+// each op cost. `make bench` runs it on images of a few sizes.
+
+static LocalFileSystem *fileSystem;
+
+static void check(int ret, const string &what) {
+    if (ret < 0) {
+        cerr << "ds3bench: " << what << " failed: " << ret << endl;
+        exit(1);
+    }
+}
+
+// Runs body(0) .. body(count - 1), timing each call
+static void measure(const string &op, const string &param, int count, function<void(int)> body) {
+    const Metrics::Counter counted[] = {Metrics::BLOCK_READS, Metrics::BLOCK_WRITES, Metrics::DISK_SYSCALLS};
+    unsigned long long before[3];
+    for (int idx = 0; idx < 3; idx++) {
+        before[idx] = Metrics::total(counted[idx]);
+    }
+
+    vector<double> micros(count);
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    for (int idx = 0; idx < count; idx++) {
+        chrono::steady_clock::time_point opStart = chrono::steady_clock::now();
+        body(idx);
+        micros[idx] = chrono::duration<double, micro>(chrono::steady_clock::now() - opStart).count();
+    }
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    double perOp[3];
+    for (int idx = 0; idx < 3; idx++) {
+        perOp[idx] = (double) (Metrics::total(counted[idx]) - before[idx]) / count;
+    }
+    double mean = 0;
+    for (double m : micros) {
+        mean += m;
+    }
+    mean /= count;
+    sort(micros.begin(), micros.end());
+    double p99 = micros[min(count - 1, (int) (count * 0.99))];
+
+    printf("%-8s %-12s %6d %10.0f %9.1f %9.1f %7.1f %7.1f %8.1f %10.0f\n",
+           op.c_str(), param.c_str(), count, count / seconds, mean, p99,
+           perOp[0], perOp[1], perOp[2], (perOp[0] + perOp[1]) * UFS_BLOCK_SIZE);
+}
+
+static string fileName(int idx) {
+    return "f" + to_string(idx);
+}
+
+// create, lookup, stat and unlink of entries in one directory of size entries
+static void benchDirectory(int size) {
+    string param = "dir=" + to_string(size);
+    string dirName = "d" + to_string(size);
+    int dir = fileSystem->create(UFS_ROOT_DIRECTORY_INODE_NUMBER, UFS_DIRECTORY, dirName);
+    check(dir, "create " + dirName);
+
+    vector<int> inodes(size);
+    measure("create", param, size, [&](int idx) {
+        inodes[idx] = fileSystem->create(dir, UFS_REGULAR_FILE, fileName(idx));
+        check(inodes[idx], "create");
+    });
+    measure("lookup", param, size, [&](int idx) {
+        check(fileSystem->lookup(dir, fileName(idx)), "lookup");
+    });
+    measure("stat", param, size, [&](int idx) {
+        inode_t inode;
+        check(fileSystem->stat(inodes[idx], &inode), "stat");
+    });
+    measure("unlink", param, size, [&](int idx) {
+        check(fileSystem->unlink(dir, fileName(idx)), "unlink");
+    });
+    check(fileSystem->unlink(UFS_ROOT_DIRECTORY_INODE_NUMBER, dirName), "unlink " + dirName);
+}
+
+// Resolving a path depth directories deep, one lookup per component
+static void benchDepth(int depth, int count) {
+    vector<string> names;
+    int parent = UFS_ROOT_DIRECTORY_INODE_NUMBER;
+    for (int level = 0; level < depth; level++) {
+        names.push_back("l" + to_string(level));
+        parent = fileSystem->create(parent, UFS_DIRECTORY, names.back());
+        check(parent, "create " + names.back());
+    }
+
+    measure("resolve", "depth=" + to_string(depth), count, [&](int) {
+        int inode = UFS_ROOT_DIRECTORY_INODE_NUMBER;
+        for (const string &name : names) {
+            inode = fileSystem->lookup(inode, name);
+        }
+        check(inode, "resolve");
+    });
+
+    for (int level = depth - 1; level >= 0; level--) {
+        int dir = UFS_ROOT_DIRECTORY_INODE_NUMBER;
+        for (int up = 0; up < level; up++) {
+            dir = fileSystem->lookup(dir, names[up]);
+        }
+        check(fileSystem->unlink(dir, names[level]), "unlink " + names[level]);
+    }
+}
+
+// Overwriting and reading back one file of size bytes
+static void benchFile(int size, int count) {
+    string param = "size=" + to_string(size);
+    int inode = fileSystem->create(UFS_ROOT_DIRECTORY_INODE_NUMBER, UFS_REGULAR_FILE, "file");
+    check(inode, "create file");
+
+    vector<char> data(size), buffer(size);
+    for (int idx = 0; idx < size; idx++) {
+        data[idx] = (char) (idx * 7);
+    }
+    measure("write", param, count, [&](int idx) {
+        data[0] = (char) idx;  // so no write finds the file unchanged
+        check(fileSystem->write(inode, data.data(), size), "write");
+    });
+    measure("read", param, count, [&](int) {
+        check(fileSystem->read(inode, buffer.data(), size), "read");
+    });
+    check(fileSystem->unlink(UFS_ROOT_DIRECTORY_INODE_NUMBER, "file"), "unlink file");
+}
+
+int main(int argc, char *argv[]) {
+    if (argc != 2) {
+        cerr << argv[0] << ": diskImageFile" << endl;
+        return 1;
+    }
+
+    Disk *disk = new Disk(argv[1], UFS_BLOCK_SIZE);
+    fileSystem = new LocalFileSystem(disk);
+    super_t super;
+    fileSystem->readSuperBlock(&super);
+
+    printf("image %s: %d inodes, %d data blocks\n", argv[1], super.num_inodes, super.num_data);
+    printf("%-8s %-12s %6s %10s %9s %9s %7s %7s %8s %10s\n", "op", "case", "ops", "ops/sec",
+           "mean us", "p99 us", "reads", "writes", "syscalls", "io bytes");
+
+    // Leave room for the root and the directory itself
+    const int dirSizes[] = {16, 128, 1024};
+    for (int size : dirSizes) {
+        if (size + 2 <= super.num_inodes && size / (UFS_BLOCK_SIZE / (int) sizeof(dir_ent_t)) < super.num_data / 2) {
+            benchDirectory(size);
+        }
+    }
+
+    const int depths[] = {1, 4, 16};
+    for (int depth : depths) {
+        if (depth + 1 <= super.num_inodes && depth < super.num_data / 2) {
+            benchDepth(depth, 200);
+        }
+    }
+
+    const int fileSizes[] = {100, UFS_BLOCK_SIZE, 8 * UFS_BLOCK_SIZE, MAX_FILE_SIZE};
+    for (int size : fileSizes) {
+        if (size / UFS_BLOCK_SIZE + 2 <= super.num_data) {
+            benchFile(size, 50);
+        }
+    }
+
+    delete fileSystem;
+    delete disk;
+    return 0;
+}
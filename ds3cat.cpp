@@ -49,6 +49,9 @@ int main(int argc, char *argv[]) {
     if ((inodeNumber % UFS_BLOCK_SIZE) != 0) {
         blocks += 1;
     }
+    if (UFS_HAS_INLINE_DATA(&super, &inode)) {
+        blocks = 0;  // small files keep their data in the inode
+    }
     for (int i = 0; i < blocks ; i++) {
         if (inode.direct[i] >= static_cast<unsigned int>(super.data_region_addr) &&
             inode.direct[i] < static_cast<unsigned int>(super.data_region_addr + super.data_region_len)) {
@@ -0,0 +1,32 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "LocalFileSystem.h"
+#include "Disk.h"
+#include "ufs.h"
+
+using namespace std;
+
+int main(int argc, char *argv[]) {
+    if (argc != 4) {
+        cerr << argv[0] << ": Usage: diskImageFile sourceInode destinationInode" << endl;
+        return 1;
+    }
+
+    // Parse command-line arguments
+    string diskImage = argv[1];
+    int sourceInode = atoi(argv[2]);
+    int destinationInode = atoi(argv[3]);
+
+    // Initialize the disk and local file system
+    Disk disk(diskImage, UFS_BLOCK_SIZE);
+    LocalFileSystem fileSystem(&disk);
+
+    // The copy stays inside the image, sharing blocks where the image allows
+    if (fileSystem.copy(sourceInode, destinationInode) < 0) {
+        cerr << "Could not copy to dst_file" << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -12,8 +12,8 @@
 using namespace std;
 
 // Use this function with std::sort for directory entries
-bool compareByName(const dir_ent_t &a, const dir_ent_t &b) {
-    return std::strcmp(a.name, b.name) < 0;
+bool compareByName(const DirectoryEntry &a, const DirectoryEntry &b) {
+    return std::strcmp(a.name.c_str(), b.name.c_str()) < 0;
 }
 
 int main(int argc, char *argv[]) {
@@ -54,24 +54,16 @@ for (const string &component : components) {
     }
 
 if (inode.type == UFS_DIRECTORY) {
-    unsigned char buffer[inode.size];
-    int bytesRead = fileSystem.read(currentInode, buffer, inode.size);
-
-    if (bytesRead < 0) {
+    vector<DirectoryEntry> entryList;
+    if (fileSystem.readDirectory(currentInode, entryList) < 0) {
         cerr << "Directory not found" << endl;
         return 1;
     }
 
-    dir_ent_t *entries = reinterpret_cast<dir_ent_t *>(buffer);
-    int numEntries = bytesRead / sizeof(dir_ent_t);
-
-    vector<dir_ent_t> entryList(entries, entries + numEntries);
     std::sort(entryList.begin(), entryList.end(), compareByName);
 
-    for (const dir_ent_t &entry : entryList) {
-        if ( entry.name[0] != '\0') { // Allow 0 as it is valid for `.` and `..`
-            cout << entry.inum << "\t" << entry.name << endl;
-        }
+    for (const DirectoryEntry &entry : entryList) {
+        cout << entry.inum << "\t" << entry.name << endl;
     }
 } else {
     // Extract only the last component of the path to print the file name
@@ -0,0 +1,34 @@
+#include <iostream>
+#include <string>
+#include <cstdlib>
+#include "Disk.h"
+#include "LocalFileSystem.h"
+#include "ufs.h"
+
+int main(int argc, char *argv[]) {
+    if (argc != 6) {
+        std::cerr << argv[0] << ": diskImageFile srcParentInode srcName dstParentInode dstName" << std::endl;
+        return 1;
+    }
+
+    std::string diskImageFileName = argv[1];
+    int srcParentInodeNumber = atoi(argv[2]);
+    std::string srcName = argv[3];
+    int dstParentInodeNumber = atoi(argv[4]);
+    std::string dstName = argv[5];
+
+    Disk *disk = new Disk(diskImageFileName, UFS_BLOCK_SIZE);
+    LocalFileSystem *fs = new LocalFileSystem(disk);
+
+    int ret = fs->rename(srcParentInodeNumber, srcName, dstParentInodeNumber, dstName);
+    if (ret != 0) {
+        std::cerr << "Error moving entry" << std::endl;
+        delete fs;
+        delete disk;
+        return 1;
+    }
+
+    delete fs;
+    delete disk;
+    return 0;
+}
@@ -1,60 +1,15 @@
 #include "dthread.h"
+#include "Log.h"
 #include <iostream>
 #include <string>
-#include <vector>
 #include <sstream>
 
-#include <fcntl.h>
-#include <unistd.h>
-
-pthread_mutex_t print_lock = PTHREAD_MUTEX_INITIALIZER;
-std::vector<pthread_t> thread_list;
-int logFd = -1;
-
 void set_log_file(std::string file_name) {
-  logFd = open(file_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
-  if (logFd < 0) {
-    std::cerr << "Could not open log file: " << file_name << std::endl;
-    exit(1);
-  }
+  Log::open(file_name);
 }
 
 void sync_print(std::string function, std::string payload) {
-  int ret = pthread_mutex_lock(&print_lock);
-  if (ret != 0) {
-    std::cerr << "pthread lock mutex error!" << std::endl;
-    exit(1);
-  }
-
-  // search through our thread list to find this thread
-  pthread_t self = pthread_self();
-  int tid = -1;
-  for (size_t idx = 0; idx < thread_list.size(); idx++) {
-    if (pthread_equal(self, thread_list[idx])) {
-      tid = idx;
-      break;
-    }
-  }
-
-  // if we don't find self in our thread list, add it
-  if (tid < 0) {
-    tid = thread_list.size();
-    thread_list.push_back(self);
-  }
-
-  std::stringstream write_stream;
-  write_stream << function << " thread: " << tid << " " << payload << std::endl;
-  std::string write_buffer = write_stream.str();
-  ret = write(logFd, write_buffer.c_str(), write_buffer.length());
-  if (ret >= 0 && (size_t) ret != write_buffer.length()) {
-    std::cerr << "log file write error, ret = " << ret << " expected " << write_buffer.length() << std::endl;
-    exit(1);
-  }
-  ret = pthread_mutex_unlock(&print_lock);
-  if (ret != 0) {
-    std::cerr << "pthread mutex unlock error!" << std::endl;
-    exit(1);
-  }
+  Log::write(function.c_str(), "%s", payload.c_str());
 }
 
 void sync_print_thread(std::string function, pthread_mutex_t *mutex, pthread_cond_t *cond) {
@@ -3,6 +3,7 @@
 #include <assert.h>
 #include <signal.h>
 #include <fcntl.h>
+#include <time.h>
 
 #include <iostream>
 #include <memory>
@@ -20,7 +21,13 @@
 #include "DistributedFileSystemService.h"
 #include "MySocket.h"
 #include "MyServerSocket.h"
+#include "SocketBuffer.h"
 #include "dthread.h"
+#include "Log.h"
+#include "Metrics.h"
+#include "MetricsService.h"
+#include "Trace.h"
+#include "TraceService.h"
 
 using namespace std;
 int PORT = 8080;
@@ -30,8 +37,18 @@ string BASEDIR = "ds3";
 string SCHEDALG = "FIFO";
 string LOGFILE = "/dev/null";
 string DISKFILE = "disk.img";
+int SCRUB_RATE = 256;  // blocks per second the checksum scrubber may read
+int CACHE_MB = 32;     // size of the GET response cache, 0 to turn it off
+int READ_BUFFER_KB = 64;  // initial size of the socket read buffer
+int GZIP_CACHE_MB = -1;  // gzip text GET responses with this much cache; -1: off
 
 vector<HttpService *> services;
+// Metrics route ids: one for each service, in the same order, and one for
+// requests no service claimed
+vector<int> serviceRoutes;
+int noRoute;
+// Reused for every connection
+SocketBuffer *readBuffer;
 
 HttpService *find_service(HTTPRequest *request) {
    // find a service that is registered for this path prefix
@@ -45,6 +62,25 @@ HttpService *find_service(HTTPRequest *request) {
 }
 
 
+int route_of(HttpService *service) {
+  for (unsigned int idx = 0; idx < services.size(); idx++) {
+    if (services[idx] == service) {
+      return serviceRoutes[idx];
+    }
+  }
+  return noRoute;
+}
+
+Metrics::Method method_of(HTTPRequest *request) {
+  if (request->isHead()) return Metrics::HEAD;
+  if (request->isGet()) return Metrics::GET;
+  if (request->isPut()) return Metrics::PUT;
+  if (request->isPost()) return Metrics::POST;
+  if (request->isDelete()) return Metrics::DELETE;
+  if (request->isMove()) return Metrics::MOVE;
+  return Metrics::OTHER;
+}
+
 void invoke_service_method(HttpService *service, HTTPRequest *request, HTTPResponse *response) {
   stringstream payload;
 
@@ -79,17 +115,17 @@ void invoke_service_method(HttpService *service, HTTPRequest *request, HTTPRespo
 }
 
 void handle_request(MySocket *client) {
-  HTTPRequest *request = new HTTPRequest(client, PORT);
+  readBuffer->clear();
+  HTTPRequest *request = new HTTPRequest(client, PORT, readBuffer);
   HTTPResponse *response = new HTTPResponse();
-  stringstream payload;
   
   // read in the request
   bool readResult = false;
+  long long readStart = Trace::now();
   try {
-    payload << "client: " << (void *) client;
-    sync_print("read_request_enter", payload.str());
+    LOG_INFO("read_request_enter", "client: %p", (void *) client);
     readResult = request->readRequest();
-    sync_print("read_request_return", payload.str());
+    LOG_INFO("read_request_return", "client: %p", (void *) client);
   } catch (...) {
     // swallow it
   }    
@@ -98,26 +134,57 @@ void handle_request(MySocket *client) {
     // there was a problem reading in the request, bail
     delete response;
     delete request;
-    sync_print("read_request_error", payload.str());
+    LOG_INFO("read_request_error", "client: %p", (void *) client);
     return;
   }
   
+  long long start = Trace::now();
+  Metrics::count(Metrics::BYTES_IN, request->bytesRead());
+
+  // Trace this request if it asks to be; reading it is timed either way
+  string_view traceHeader;
+  if (request->findHeader("X-DS3-Trace", &traceHeader)) {
+    response->setHeader("X-DS3-Trace-Id", to_string(Trace::start()));
+    Trace::addSpan("read request", readStart, start,
+                   Trace::arg("socket_read_us", request->socketReadMicros()) + "," +
+                   Trace::arg("parse_us", request->parseMicros()));
+  }
+
+  // The access log: one "METHOD TARGET BYTES" line per request, with the
+  // query string in TARGET, which loadgen -r can replay. A copy adds
+  // "x-copy-source SOURCE", since its body alone doesn't say what it did.
+  cout << Metrics::methodName(method_of(request)) << " " << request->getUrl() << " "
+       << request->getBodyLength();
+  string_view copySource;
+  if (request->findHeader("x-copy-source", &copySource)) {
+    cout << " x-copy-source " << copySource;
+  }
+  cout << endl;
+
   HttpService *service = find_service(request);
-  invoke_service_method(service, request, response);
+  {
+    TraceSpan span("service");
+    invoke_service_method(service, request, response);
+  }
 
   // send data back to the client and clean up
-  payload.str(""); payload.clear();
-  payload << " RESPONSE " << response->getStatus() << " client: " << (void *) client;
-  sync_print("write_response", payload.str());
-  cout << payload.str() << endl;
-  client->write(response->response());
+  LOG_INFO("write_response", " RESPONSE %d client: %p", response->getStatus(), (void *) client);
+  cout << " RESPONSE " << response->getStatus() << " client: " << (void *) client << endl;
+  {
+    TraceSpan span("write response");
+    Metrics::count(Metrics::BYTES_OUT, response->send(client));
+  }
+  long long end = Trace::now();
+  Metrics::recordLatency(route_of(service), method_of(request), end - start);
+  if (Trace::active()) {
+    Trace::addSpan("request", readStart, end, Trace::arg("path", request->getPath()));
+    Trace::finish();
+  }
     
   delete response;
   delete request;
 
-  payload.str(""); payload.clear();
-  payload << " client: " << (void *) client;
-  sync_print("close_connection", payload.str());
+  LOG_INFO("close_connection", " client: %p", (void *) client);
   client->close();
   delete client;
 }
@@ -127,7 +194,7 @@ int main(int argc, char *argv[]) {
   signal(SIGPIPE, SIG_IGN);
   int option;
 
-  while ((option = getopt(argc, argv, "d:p:t:b:s:l:i:")) != -1) {
+  while ((option = getopt(argc, argv, "d:p:t:b:s:l:i:r:m:k:z:")) != -1) {
     switch (option) {
     case 'd':
       BASEDIR = string(optarg);
@@ -150,29 +217,54 @@ int main(int argc, char *argv[]) {
     case 'i':
       DISKFILE = string(optarg);
       break;
+    case 'r':
+      SCRUB_RATE = atoi(optarg);
+      break;
+    case 'm':
+      CACHE_MB = atoi(optarg);
+      break;
+    case 'k':
+      READ_BUFFER_KB = atoi(optarg);
+      break;
+    case 'z':
+      GZIP_CACHE_MB = atoi(optarg);
+      break;
     default:
-      cerr<< "usage: " << argv[0] << " [-p port] [-t threads] [-b buffers] [-i diskFile]" << endl;
+      cerr<< "usage: " << argv[0] << " [-p port] [-t threads] [-b buffers] [-i diskFile] [-r scrubBlocksPerSecond] [-m cacheMB] [-k readBufferKB] [-z gzipCacheMB]" << endl;
       exit(1);
     }
   }
 
   set_log_file(LOGFILE);
+  readBuffer = new SocketBuffer((size_t) READ_BUFFER_KB * 1024);
 
   cout << "Lisening on port " << PORT << endl;
   
-  sync_print("init", "");
+  LOG_INFO("init");
   MyServerSocket *server = new MyServerSocket(PORT);
   MySocket *client;
 
   // The order that you push services dictates the search order
   // for path prefix matching
-  services.push_back(new DistributedFileSystemService(DISKFILE));
+  DistributedFileSystemService *fileSystemService = new DistributedFileSystemService(DISKFILE);
+  fileSystemService->startScrubber(SCRUB_RATE);
+  fileSystemService->enableCache((size_t) CACHE_MB * 1024 * 1024);
+  if (GZIP_CACHE_MB >= 0) {
+    fileSystemService->enableCompression((size_t) GZIP_CACHE_MB * 1024 * 1024);
+  }
+  services.push_back(new MetricsService());
+  services.push_back(new TraceService());
+  services.push_back(fileSystemService);
   services.push_back(new FileService(BASEDIR));
+  for (unsigned int idx = 0; idx < services.size(); idx++) {
+    serviceRoutes.push_back(Metrics::addRoute(services[idx]->pathPrefix()));
+  }
+  noRoute = Metrics::addRoute("none");
   
   while(true) {
-    sync_print("waiting_to_accept", "");
+    LOG_INFO("waiting_to_accept");
     client = server->accept();
-    sync_print("client_accepted", "");
+    LOG_INFO("client_accepted");
     handle_request(client);
   }
 }
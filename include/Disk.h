@@ -3,6 +3,7 @@
 
 #include <string>
 #include <deque>
+#include <set>
 
 struct UndoRecord {
   int blockNumber;
@@ -16,16 +17,33 @@ class Disk {
   void writeBlock(int blockNumber, void *buffer);
   int numberOfBlocks();
 
+  // Writes in a transaction aren't synced one by one: commit and rollback
+  // sync the image once for all of them
   void beginTransaction();
   void commit();
   void rollback();
+  // A point in the current transaction that rollbackTo can return to,
+  // undoing only what was written since
+  size_t savepoint();
+  void rollbackTo(size_t savepoint);
+  // Changes whenever a rollback undoes writes, so anything read from the
+  // image and kept in memory can tell it may be out of date
+  unsigned long generation();
   
  private:
+  void sync();
+
   std::string imageFile;
   int blockSize;
   int imageFileSize;
   bool isInTransaction;
+  bool isDirty;  // written in this transaction and not synced yet
+  bool isRestoring;  // writing back undo records, which need none
+  unsigned long rollbacks;
   std::deque<struct UndoRecord> undoLog;
+  // Blocks with an undo record since the last savepoint; a later write to
+  // one of them needs none
+  std::set<int> undoBlocks;
 };
 
 #endif
@@ -3,19 +3,69 @@
 
 #include "HttpService.h"
 #include "LocalFileSystem.h"
+#include "ObjectCache.h"
 
+#include <pthread.h>
 #include <string>
+#include <vector>
 
 class DistributedFileSystemService : public HttpService {
  public:
   DistributedFileSystemService(std::string driveFile);
 
+  virtual void head(HTTPRequest *request, HTTPResponse *response);
   virtual void get(HTTPRequest *request, HTTPResponse *response);
   virtual void put(HTTPRequest *request, HTTPResponse *response);
+  // POST /ds3/?batch: many GETs, PUTs and DELETEs in one request
+  virtual void post(HTTPRequest *request, HTTPResponse *response);
   virtual void del(HTTPRequest *request, HTTPResponse *response);
+  virtual void move(HTTPRequest *request, HTTPResponse *response);
+
+  // Starts a thread that keeps checking every file against its block
+  // checksums, reading at most blocksPerSecond blocks a second. Does
+  // nothing on images without UFS_FEATURE_CHECKSUMS.
+  void startScrubber(int blocksPerSecond);
+  // Caches rendered GET responses, up to capacity bytes of bodies. Off (0)
+  // unless called.
+  void enableCache(size_t capacity);
+  // Gzips GET responses that are directory listings or text files for
+  // clients that accept it, keeping up to capacity bytes of compressed
+  // bodies by ETag. Off unless called.
+  void enableCompression(size_t capacity);
 
 private:
+  // One operation of a batch
+  struct BatchItem {
+    std::string method;
+    std::string path;  // under /ds3
+    std::string body;
+  };
+  static std::vector<BatchItem> parseBatch(const std::string &body);
+  // Runs item and returns its body; throws like the single requests do
+  std::string runBatchItem(const BatchItem &item);
+  // Whether the GET response for path, with a body of bodyLength bytes, is
+  // gzipped for this request; sets Vary when it depends on Accept-Encoding.
+  // Text that doesn't shrink still goes out gzipped, a few bytes bigger:
+  // the variant, and so its ETag, is settled before the body is read.
+  bool negotiateGzip(HTTPRequest *request, HTTPResponse *response, const std::string &path, bool directory,
+                     size_t bodyLength);
+  // The compressed body cached for the response tagged tag, or NULL
+  const std::string *cachedGzip(const std::string &tag);
+  // Compresses body and keeps it for tag, unless tag is ""
+  std::string gzipAndKeep(const std::string &body, const std::string &tag);
+  // For HEAD: marks the response gzipped, with the compressed length if
+  // the body for tag is cached and no Content-Length otherwise
+  void sendGzipLength(HTTPResponse *response, const std::string &tag);
+  // Sets body, gzipped (from the cache when tag has an entry) if gzip
+  void sendBody(HTTPResponse *response, std::string body, const std::string &tag, bool gzip);
+  static void *scrubLoop(void *arg);
+
   LocalFileSystem *fileSystem;
+  // Held by each request and by the scrubber between files
+  pthread_mutex_t lock;
+  int scrubRate;
+  ObjectCache *cache;
+  ObjectCache *gzipCache;  // compressed bodies by ETag; NULL: compression off
 };
 
 #endif
@@ -3,8 +3,36 @@
 
 #include "HttpService.h"
 
+#include <pthread.h>
+#include <sys/stat.h>
+
+#include <list>
+#include <map>
+#include <memory>
 #include <string>
 
+// A file under basedir as FileService serves it. Everything a response
+// needs is worked out when the file is opened and holds until it changes.
+struct StaticFile {
+  ~StaticFile();
+
+  std::string body;  // the contents, for files small enough to keep
+  int fd;            // kept open to sendfile bigger files from, else -1
+  struct stat st;    // the file when it was opened, to notice changes
+  std::string contentType;  // "" for the response's default
+  bool compressible;  // text, which may have a precompressed name.gz
+  std::string etag;
+  std::string lastModified;
+};
+
+/**
+ * Serves the files under basedir. Files stay open or in memory between
+ * requests, in an LRU cache, so a hit costs one stat() to check that the
+ * file hasn't changed. Files over SENDFILE_THRESHOLD are sent with sendfile
+ * from the open descriptor rather than kept in memory. A precompressed
+ * sibling, name.gz, goes to clients that accept gzip in place of name.
+ * Only text files are looked for a sibling, at the cost of a second stat().
+ */
 class FileService : public HttpService {
  public:
   FileService(std::string basedir);
@@ -12,11 +40,29 @@ class FileService : public HttpService {
   virtual void get(HTTPRequest *request, HTTPResponse *response);
   virtual void head(HTTPRequest *request, HTTPResponse *response);
 
+  static const size_t SENDFILE_THRESHOLD = 64 * 1024;
+  static const size_t MAX_FILES = 256;
+  static const size_t MAX_BYTES = 16 * 1024 * 1024;  // of cached bodies
+
 private:
   bool endswith(std::string str, std::string suffix);
-  std::string readFile(std::string path);
+  // The file at path, from the cache unless it changed on disk; NULL if
+  // there is no regular file there
+  std::shared_ptr<StaticFile> openFile(const std::string &path);
+  std::shared_ptr<StaticFile> loadFile(const std::string &path);
+  void evict();
+  void serve(HTTPRequest *request, HTTPResponse *response, bool withBody);
+
+  struct Entry {
+    std::shared_ptr<StaticFile> file;
+    std::list<std::string>::iterator lru;
+  };
 
   std::string m_basedir;
+  pthread_mutex_t m_lock;
+  std::map<std::string, Entry> m_files;
+  std::list<std::string> m_lru;  // most recently used first
+  size_t m_bytes;
 };
 
 #endif
@@ -4,12 +4,15 @@
 #include "http_parser.h"
 
 #include <string>
+#include <string_view>
 #include <vector>
 #include <map>
 
 class HTTP {
  public:
     typedef enum {INIT, HEADER, FIELD, VALUE, BODY, DONE} HttpState;
+    // Headers looked up often enough to get a slot of their own
+    typedef enum {CONTENT_LENGTH, HOST, IF_NONE_MATCH, RANGE, ACCEPT_ENCODING, NUM_COMMON_HEADERS} CommonHeader;
 
     HTTP(http_parser_type httpType = HTTP_REQUEST);
     ~HTTP();
@@ -30,10 +33,16 @@ class HTTP {
     bool isDelete() {return m_method == HTTP_DELETE;}
     bool isMove() {return m_method == HTTP_MOVE;}
     std::string getBody();
+    size_t getBodyLength() {return m_body.size();}
     std::string getQuery() {return m_query;}
-    std::vector< std::pair< std::string *, std::string *> > getHeaders() {
-      return m_headers;
-    }
+    // The value of the header named name (case-insensitive). Returns false
+    // if there is none. The view points into this object and is good until
+    // it is destroyed; nothing is allocated and nothing throws.
+    bool findHeader(std::string_view name, std::string_view *value) const;
+    bool findHeader(CommonHeader header, std::string_view *value) const;
+    int numHeaders() const {return m_headers.size();}
+    std::string_view headerField(int idx) const;
+    std::string_view headerValue(int idx) const;
   
  private:
     static int message_begin_cb(http_parser *parser);
@@ -54,6 +63,7 @@ class HTTP {
     void appendHeaderField(const char *at, size_t len);
     void appendHeaderValue(const char *at, size_t len);
     void addHeaderField();
+    static int commonHeader(std::string_view name);
     void messageComplete(unsigned char method);
 
     http_parser_settings m_settings;
@@ -65,10 +75,18 @@ class HTTP {
     std::string m_url;
     std::string m_path;
     std::string m_query;
-    std::string m_host;
-    std::string *m_field;
-    std::string *m_value;
-    std::vector< std::pair< std::string *, std::string *> > m_headers;
+    // Header fields and values are copied back to back into one arena and
+    // recorded as offsets, since the arena may move while it grows
+    struct Header {
+      unsigned int field;
+      unsigned int fieldLen;
+      unsigned int value;
+      unsigned int valueLen;
+    };
+    std::string m_arena;
+    std::vector<Header> m_headers;
+    bool m_inHeader;
+    int m_common[NUM_COMMON_HEADERS];
     std::string m_body;
     std::string m_statusStr;
     unsigned char m_method;
@@ -2,6 +2,7 @@
 #define HTTP_REQUEST_H_
 
 #include "MySocket.h"
+#include "SocketBuffer.h"
 #include "http_parser.h"
 #include "HTTP.h"
 
@@ -10,11 +11,14 @@
 
 #include <map>
 #include <string>
+#include <string_view>
 #include <vector>
 
 class HTTPRequest {
 public:
-  HTTPRequest(MySocket *sock, int serverPort);
+  // Reads into buffer, the connection's, if there is one and into a buffer
+  // of its own otherwise
+  HTTPRequest(MySocket *sock, int serverPort, SocketBuffer *buffer = NULL);
   ~HTTPRequest();
   
   bool readRequest();
@@ -24,8 +28,16 @@ public:
   std::string getUrl();
   std::string getPath();
   std::vector<std::string> getPathComponents();
+  // Sets value to the header named key and returns true, or returns false.
+  // The view is good for the life of the request.
+  bool findHeader(std::string_view key, std::string_view *value);
+  // Throws if there is no such header
   std::string getHeader(std::string key);
   bool hasAuthToken();
+  bool hasHeader(std::string_view key);
+  // Whether Accept-Encoding takes coding ("gzip"): named, or covered by
+  // "*", with a q-value above 0
+  bool acceptsEncoding(std::string_view coding);
   std::string getAuthToken();
   bool isConnect();
   bool isGet() {return m_http->isGet();}
@@ -37,17 +49,26 @@ public:
   std::map<std::string, std::string> getParams();
   WwwFormEncodedDict formEncodedBody();
   std::string getBody() {return m_http->getBody();}
+  size_t getBodyLength() {return m_http->getBodyLength();}
   
   void printDebugInfo();
+  unsigned long bytesRead() {return m_totalBytesRead;}
+  // Microseconds readRequest spent waiting on the socket and parsing
+  long long socketReadMicros() {return m_socketReadMicros;}
+  long long parseMicros() {return m_parseMicros;}
     
  protected:
     void onRead(const char *buffer, unsigned int len);
 
     MySocket *m_sock;
+    SocketBuffer *m_buffer;
+    bool m_ownsBuffer;
     HTTP *m_http;
     int m_serverPort;
     unsigned long m_totalBytesRead;
     unsigned long m_totalBytesWritten;
+    long long m_socketReadMicros;
+    long long m_parseMicros;
 };
 
 #endif
@@ -2,26 +2,53 @@
 #define HTTP_RESPONSE_H_
 
 #include <map>
+#include <memory>
 #include <string>
 
+#include <sys/types.h>
+
+#include "MySocket.h"
+
 class HTTPResponse {
  public:
   HTTPResponse();
   void withStreaming();
+  // Leaves out Content-Length, for a HEAD response that doesn't know the
+  // length of the body it leaves out
+  void withoutLength();
   void setHeader(std::string name, std::string value);
   void setBody(std::string data);
+  // The body is length bytes of the file open on fd from offset, sent with
+  // sendfile after the head. owner keeps fd open until the response is
+  // deleted. setBody replaces it.
+  void setBodyFile(int fd, off_t offset, size_t length, std::shared_ptr<void> owner);
   void setContentType(std::string contentType);
+  // Marks the body as encoded with coding ("gzip") and says the response
+  // depends on Accept-Encoding
+  void setContentEncoding(std::string coding);
   void setStatus(int status);
   int getStatus();
   std::string response();
+  // Sends the response: the status line and headers are formatted into a
+  // per-thread buffer and go out together with the body in one writev,
+  // without being joined into one string first. Returns the bytes sent.
+  // A body file follows the head with sendfile.
+  size_t send(MySocket *socket);
 
  private:
   std::string statusToString();
+  // Appends the status line and headers, up to the blank line, to out
+  void formatHead(std::string &out);
 
   int status;
   bool streaming;
+  bool lengthKnown;
   std::map<std::string, std::string> headers;
   std::string body;
+  int bodyFd;  // -1 unless the body is a file
+  off_t bodyOffset;
+  size_t bodyLength;
+  std::shared_ptr<void> bodyOwner;
   std::string contentType;
 };
 
@@ -21,6 +21,8 @@ class HttpUtils {
   static void writeLastChunk(MySocket *client);
 
   static std::vector<std::string> split(const std::string &s, char delim);
+  // seconds since the epoch as an HTTP date ("Sun, 06 Nov 1994 08:49:37 GMT")
+  static std::string httpDate(long long seconds);
 
  private:
   static std::vector<std::string> &split(const std::string &s,
@@ -2,6 +2,8 @@
 #define _LOCAL_FILE_SYSTEM_H_
 
 #include <string>
+#include <vector>
+#include <unordered_map>
 
 #include "Disk.h"
 #include "ufs.h"
@@ -43,6 +45,16 @@
 #define EINVALIDTYPE       (9)
 // Unlinking '.' or '..'
 #define EUNLINKNOTALLOWED  (10)
+// Moving a directory into itself or one of its subdirectories
+#define EINVALIDMOVE       (11)
+// A file block doesn't match its checksum
+#define ECORRUPT           (12)
+
+// One in-use directory entry, independent of the on-disk entry format
+struct DirectoryEntry {
+  std::string name;
+  int inum;
+};
 
 class LocalFileSystem {
  public:
@@ -71,6 +83,20 @@ class LocalFileSystem {
    * Failure modes: invalid inodeNumber
    */
   int stat(int inodeNumber, inode_t *inode);
+
+  /**
+   * Read the version of a file.
+   *
+   * On images with UFS_FEATURE_VERSIONS every create, write, append and copy
+   * bumps the version of the inode it changes and sets mtime to the current
+   * time, so an unchanged (inodeNumber, version) means unchanged contents.
+   * Only the inode extension region is read, never a data block.
+   *
+   * Success: return 0; version and mtime are 0 on images without versions
+   * Failure: return -EINVALIDINODE
+   * Failure modes: invalid inodeNumber
+   */
+  int getVersion(int inodeNumber, unsigned long long *version, long long *mtime);
   
   /**
    * Makes a file or directory.
@@ -81,7 +107,8 @@ class LocalFileSystem {
    * Success: return the inode number of the new file or directory
    * Failure: -EINVALIDINODE, -EINVALIDNAME, -EINVALIDTYPE, -ENOTENOUGHSPACE.
    * Failure modes: parentInodeNumber does not exist or is not a directory, or
-   * name is too long. If name already exists and is of the correct type,
+   * name is too long (DIR_ENT_NAME_SIZE - 1 bytes, or DIR_REC_MAX_NAME_LEN on
+   * images with long names). If name already exists and is of the correct type,
    * return success, but if the name already exists and is of the wrong type,
    * return an error.
    */
@@ -91,15 +118,49 @@ class LocalFileSystem {
    * Write the contents of a file.
    *
    * Writes a buffer of size to the file, replacing any content that
-   * already exists.
+   * already exists. Blocks whose contents don't change aren't rewritten. On
+   * images with UFS_FEATURE_DEDUP a block whose contents already exist in
+   * some file is shared with it instead of being written.
+   * On images with UFS_FEATURE_COMPRESSION the file is stored compressed
+   * whenever that takes fewer data blocks.
    *
    * Success: number of bytes written
-   * Failure: -EINVALIDINODE, -EINVALIDSIZE, -EINVALIDTYPE.
+   * Failure: -EINVALIDINODE, -EINVALIDSIZE, -EINVALIDTYPE, -ENOTENOUGHSPACE.
    * Failure modes: invalid inodeNumber, invalid size, not a regular file
-   * (because you can't write to directories).
+   * (because you can't write to directories), or not enough free blocks.
+   * Every check is made before the first write, so a failed write leaves
+   * the file as it was.
    */
   int write(int inodeNumber, const void *buffer, int size);
 
+  /**
+   * Append to the end of a file.
+   *
+   * Adds size bytes from buffer after the current contents of the file.
+   * Only the file's last block and the blocks after it are written.
+   *
+   * Success: number of bytes appended
+   * Failure: -EINVALIDINODE, -EINVALIDSIZE, -EINVALIDTYPE, -ENOTENOUGHSPACE.
+   * Failure modes: invalid inodeNumber, invalid size or the file would grow
+   * past MAX_FILE_SIZE, not a regular file, or not enough free blocks.
+   */
+  int append(int inodeNumber, const void *buffer, int size);
+
+  /**
+   * Copy the contents of one file to another.
+   *
+   * Replaces the contents of dstInodeNumber with those of srcInodeNumber. On
+   * images with UFS_FEATURE_SHARED_BLOCKS no data is copied: the destination
+   * shares the source's blocks and write() gives a file its own copy of a
+   * shared block when it changes (copy-on-write). Other images copy the blocks.
+   *
+   * Success: number of bytes copied
+   * Failure: -EINVALIDINODE, -EINVALIDTYPE, -ENOTENOUGHSPACE.
+   * Failure modes: invalid inode numbers, either inode is not a regular file,
+   * or not enough free blocks for the copy.
+   */
+  int copy(int srcInodeNumber, int dstInodeNumber);
+
   /**
    * Read the contents of a file or directory.
    *
@@ -107,12 +168,31 @@ class LocalFileSystem {
    * inodeNumber. The routine should work for either a file or directory;
    * directories should return data in the format specified by dir_ent_t.
    *
+   * On images with UFS_FEATURE_CHECKSUMS every file block read is checked
+   * against its checksum.
+   *
    * Success: number of bytes read
-   * Failure: -EINVALIDINODE, -EINVALIDSIZE.
-   * Failure modes: invalid inodeNumber, invalid size.
+   * Failure: -EINVALIDINODE, -EINVALIDSIZE, -ECORRUPT.
+   * Failure modes: invalid inodeNumber, invalid size, a block of the file
+   * doesn't match its checksum.
    */
   int read(int inodeNumber, void *buffer, int size);
 
+  /**
+   * Check the blocks of a file against their checksums.
+   *
+   * Reads every data block of the regular file inodeNumber and compares it
+   * with the checksum recorded when it was written, as read() does, but
+   * counts the bad blocks instead of stopping at the first one. This is
+   * what a background scrubber calls to find corruption in files nobody
+   * reads.
+   *
+   * Success: number of corrupt blocks; 0 on images without checksums
+   * Failure: -EINVALIDINODE, -ENOTALLOCATED, -EINVALIDTYPE.
+   * Failure modes: invalid inodeNumber, inode not in use, not a regular file.
+   */
+  int scrub(int inodeNumber);
+
   /**
    * Remove a file or directory.
    *
@@ -126,6 +206,41 @@ class LocalFileSystem {
    * existing is NOT a failure by our definition. You can't unlink '.' or '..'
    */
   int unlink(int parentInodeNumber, std::string name);
+
+  /**
+   * Rename or move a file or directory.
+   *
+   * Moves the entry srcName in directory srcParentInodeNumber to dstName in
+   * directory dstParentInodeNumber. Only directory entries change (plus '..'
+   * when a directory moves to a new parent); the inode and its data blocks
+   * stay where they are. An existing dstName is replaced if it has the same
+   * type and, for a directory, is empty. Every check is made before the first
+   * write, so a failed rename leaves the file system unchanged.
+   *
+   * Success: 0
+   * Failure: -EINVALIDINODE, -ENOTFOUND, -EINVALIDNAME, -EINVALIDTYPE,
+   * -EDIRNOTEMPTY, -EINVALIDMOVE, -ENOTENOUGHSPACE
+   * Failure modes: either parent does not exist or isn't a directory, srcName
+   * does not exist, a name is '.', '..' or too long, dstName exists with a
+   * different type or is a non-empty directory, a directory would move into
+   * its own subtree, or the destination directory can't grow.
+   */
+  int rename(int srcParentInodeNumber, std::string srcName,
+             int dstParentInodeNumber, std::string dstName);
+
+  /**
+   * List a directory.
+   *
+   * Decodes the directory specified by inodeNumber, whichever entry format
+   * the image uses (see UFS_FEATURE_LONG_NAMES), and appends one entry per
+   * name in it to entries, including "." and "..". Entries are in on-disk
+   * order, not sorted.
+   *
+   * Success: number of entries appended
+   * Failure: -EINVALIDINODE
+   * Failure modes: invalid inodeNumber or not a directory.
+   */
+  int readDirectory(int inodeNumber, std::vector<DirectoryEntry> &entries);
   
   /**
    * Some helper functions that you need to implement and use in your
@@ -142,11 +257,91 @@ class LocalFileSystem {
   void writeDataBitmap(super_t *super, unsigned char *dataBitmap);
   void readInodeRegion(super_t *super, inode_t *inodes);
   void writeInodeRegion(super_t *super, inode_t *inodes);
+  // Block reference counts, UFS_FEATURE_SHARED_BLOCKS only
+  void readRefcounts(super_t *super, unsigned int *refcounts);
+  void writeRefcounts(super_t *super, unsigned int *refcounts);
+  // Block fingerprints, UFS_FEATURE_DEDUP only
+  void readFingerprints(super_t *super, unsigned long long *fingerprints);
+  void writeFingerprints(super_t *super, unsigned long long *fingerprints);
+  // Block checksums, UFS_FEATURE_CHECKSUMS only
+  void readChecksums(super_t *super, unsigned int *checksums);
+  void writeChecksums(super_t *super, unsigned int *checksums);
 
   // Normally we'd mark this as private but we expose it so that you can access
   // it in a function you add that is not part of the LocalFileSystem object but
   // can still access the disk.
   Disk *disk;
+
+ private:
+  // stat() for callers that already have the superblock
+  int readInode(super_t *super, int inodeNumber, inode_t *inode);
+  // Reads the blocks of a directory into entries and returns the number of
+  // slots in use (size / sizeof(dir_ent_t)). Slots with inum == -1 are free.
+  int readDirectoryEntries(inode_t *dirInode, std::vector<dir_ent_t> &entries);
+  // Same for long-name directories: decodes the in-use records of each block
+  // and returns the number of blocks.
+  int readDirectoryRecords(inode_t *dirInode, std::vector<std::vector<DirectoryEntry> > &blocks);
+  // Appends the in-use entries of a directory in either format.
+  int listDirectory(super_t *super, inode_t *dirInode, std::vector<DirectoryEntry> &entries);
+
+  // Entry-level edits shared by create, unlink and rename. They write the
+  // directory blocks they change; the caller writes dirInode (in its inode
+  // region copy) and dataBitmap back.
+  //
+  // Returns the inode number name refers to, or -ENOTFOUND.
+  int findDirectoryEntry(super_t *super, inode_t *dirInode, std::string name);
+  // Adds name, reusing free space before growing the directory by a block.
+  // Returns 0, or -ENOTENOUGHSPACE without writing anything.
+  int addDirectoryEntry(super_t *super, inode_t *dirInode, unsigned char *dataBitmap,
+                        std::string name, int inum);
+  // Removes name and compacts the directory, returning emptied blocks.
+  // Returns the inode number the entry referred to, or -ENOTFOUND.
+  int removeDirectoryEntry(super_t *super, inode_t *dirInode, unsigned char *dataBitmap,
+                           std::string name);
+  // Points an existing entry at another inode. Returns 0 or -ENOTFOUND.
+  int replaceDirectoryEntry(super_t *super, inode_t *dirInode, std::string name, int inum);
+  // Reads the refcount region into a new array, or returns NULL on images
+  // without shared blocks.
+  unsigned int *loadRefcounts(super_t *super);
+  // Same for checksums, on images with UFS_FEATURE_CHECKSUMS
+  unsigned int *loadChecksums(super_t *super);
+  // Reads a block of a regular file and checks it against checksums (NULL
+  // to skip the check). Returns 0 or -ECORRUPT.
+  int readFileBlock(super_t *super, unsigned int *checksums, unsigned int blockNum, void *block);
+  // The inode_ext_t of one inode; all zero on images without the region.
+  int readInodeExt(super_t *super, int inodeNumber, inode_ext_t *ext);
+  void writeInodeExt(super_t *super, int inodeNumber, inode_ext_t *ext);
+  // read() for files with UFS_INODE_COMPRESSED set
+  int readCompressed(super_t *super, inode_t *inode, inode_ext_t *ext, void *buffer, int size);
+  // Maps the fingerprint of every block a regular file points at to that
+  // block, for write() to find duplicates in on dedup images.
+  void indexFileBlocks(super_t *super, unsigned char *dataBitmap, unsigned long long *fingerprints,
+                       std::unordered_map<unsigned long long, unsigned int> &index);
+  // Reads the fingerprint region and builds fingerprintIndex, unless both
+  // are already loaded and no rollback has happened since
+  void loadFingerprintIndex(super_t *super, unsigned char *dataBitmap);
+  // Drops the index entry of a block whose contents are about to change or
+  // that has been freed
+  void forgetFingerprint(super_t *super, unsigned int blockNum);
+  // Drops one reference to a data block: a shared block loses a reference
+  // (returns true, refcounts changed), any other block is freed in dataBitmap.
+  bool releaseDataBlock(super_t *super, unsigned char *dataBitmap, unsigned int *refcounts,
+                        unsigned int blockNum);
+  // Releases the data blocks of an inode and empties it. Returns true if
+  // refcounts changed.
+  bool releaseBlocks(super_t *super, unsigned char *dataBitmap, unsigned int *refcounts, inode_t *inode);
+  // Same, and also frees the inode itself in inodeBitmap.
+  bool releaseInode(super_t *super, unsigned char *inodeBitmap, unsigned char *dataBitmap,
+                    unsigned int *refcounts, inode_t *inodes, int inodeNumber);
+
+  // UFS_FEATURE_DEDUP: the fingerprint region and an index of the blocks of
+  // regular files by fingerprint. Built by the first write that needs them
+  // and kept up to date by write() and releaseDataBlock() after that, so a
+  // write only costs the blocks it hashes and writes.
+  std::vector<unsigned long long> fingerprints;
+  std::unordered_map<unsigned long long, unsigned int> fingerprintIndex;
+  bool fingerprintsLoaded;
+  unsigned long fingerprintsGeneration;  // disk->generation() when loaded
 };  
 
 #endif
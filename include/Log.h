@@ -0,0 +1,69 @@
+#ifndef _LOG_H_
+#define _LOG_H_
+
+#include <string>
+
+#define LOG_LEVEL_DEBUG 0
+#define LOG_LEVEL_INFO 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_ERROR 3
+#define LOG_LEVEL_OFF 4
+
+// Lines below this level are compiled out, arguments and all
+// (make LOG_LEVEL=<n>)
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+
+/**
+ * The server's event log. Each line is "<event> thread: <id> <payload>",
+ * the format sync_print has always written.
+ *
+ * Logging a line takes no lock and makes no system call. Each thread
+ * formats its lines into a ring buffer of its own, and a background thread
+ * drains all the rings every few milliseconds. It puts the lines back in
+ * the order they were logged and writes them with one write(). A thread
+ * whose ring is full waits for the flusher rather than dropping lines.
+ */
+class Log {
+ public:
+  // Truncates file, logs to it and starts the flusher. Before open, or
+  // with /dev/null, logging does nothing.
+  static void open(const std::string &file);
+  // Logs event with a printf-style payload
+  static void write(const char *event, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+  // Logs event with no payload
+  static void write(const char *event);
+  // Writes out everything logged so far. Runs at exit too.
+  static void flush();
+  // The calling thread's id: 0 for the first thread to log, 1 for the
+  // next and so on
+  static int threadId();
+};
+
+#if LOG_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) Log::write(__VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) Log::write(__VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) Log::write(__VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if LOG_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) Log::write(__VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+#endif
@@ -0,0 +1,38 @@
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+#include <functional>
+#include <string>
+
+/**
+ * Counters and request latency histograms for the /metrics endpoint.
+ *
+ * Recording is lock-free: each thread adds to a shard of its own and the
+ * shards are only summed when the metrics are rendered. Latencies go into
+ * HDR-style buckets, eight to each power of two microseconds, so any
+ * quantile is known to within an eighth.
+ */
+class Metrics {
+ public:
+  typedef enum {BYTES_IN, BYTES_OUT, BLOCK_READS, BLOCK_WRITES, FSYNCS, DISK_SYSCALLS, NUM_COUNTERS} Counter;
+  typedef enum {HEAD, GET, PUT, POST, DELETE, MOVE, OTHER, NUM_METHODS} Method;
+
+  static void count(Counter counter, unsigned long long n = 1);
+  // counter summed over all threads
+  static unsigned long long total(Counter counter);
+  // Names a route (a service's path prefix) that latencies can be recorded
+  // against and returns its id. Call while starting up, before any
+  // requests; there is room for a handful.
+  static int addRoute(const std::string &name);
+  static void recordLatency(int route, Method method, unsigned long long micros);
+  // "GET", "PUT" and so on
+  static const char *methodName(Method method);
+  // Publishes a counter that something else keeps, read through value
+  // each time the metrics are rendered
+  static void addCounter(const std::string &name, const std::string &help,
+                         std::function<unsigned long long()> value);
+  // Everything, in the Prometheus text format
+  static std::string render();
+};
+
+#endif
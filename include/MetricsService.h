@@ -0,0 +1,15 @@
+#ifndef _METRICSSERVICE_H_
+#define _METRICSSERVICE_H_
+
+#include "HttpService.h"
+
+// GET /metrics: the server's counters and latency histograms in the
+// Prometheus text format
+class MetricsService : public HttpService {
+ public:
+  MetricsService();
+
+  virtual void get(HTTPRequest *request, HTTPResponse *response);
+};
+
+#endif
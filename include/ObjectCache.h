@@ -0,0 +1,62 @@
+#ifndef _OBJECTCACHE_H_
+#define _OBJECTCACHE_H_
+
+#include <list>
+#include <map>
+#include <string>
+
+// A rendered GET response: the body plus what HEAD and conditional GETs need
+struct CachedObject {
+  std::string body;
+  bool directory;
+  std::string etag;  // "" on images without versions
+  long long mtime;
+};
+
+/**
+ * An LRU cache of rendered GET responses, keyed by normalized path
+ * ("/a/b", "/" for the root) and bounded by the bytes of the bodies.
+ *
+ * It never looks at the file system, so a hit costs no path lookup and no
+ * block read. Staying correct is up to the caller, which must invalidate a
+ * path before anything under it changes.
+ */
+class ObjectCache {
+ public:
+  ObjectCache(size_t capacity);
+
+  // The object cached for path, or NULL. The pointer is good until the next
+  // call that changes the cache.
+  const CachedObject *get(const std::string &path);
+  // Caches object for path, evicting least recently used entries to make
+  // room. Objects bigger than an eighth of the capacity aren't kept.
+  void put(const std::string &path, const CachedObject &object);
+  // Drops path, everything under it and the listings of its ancestors, for
+  // a PUT, DELETE or MOVE of path.
+  void invalidate(const std::string &path);
+
+  size_t bytes() { return m_bytes; }
+  size_t capacity() { return m_capacity; }
+  unsigned long long hits() { return m_hits; }
+  unsigned long long misses() { return m_misses; }
+  unsigned long long evictions() { return m_evictions; }
+
+ private:
+  struct Entry {
+    CachedObject object;
+    std::list<std::string>::iterator lru;
+  };
+  void erase(std::map<std::string, Entry>::iterator it);
+
+  // Ordered, so the paths under a directory are one range
+  std::map<std::string, Entry> m_entries;
+  // Most recently used first
+  std::list<std::string> m_lru;
+  size_t m_capacity;
+  size_t m_bytes;
+  unsigned long long m_hits;
+  unsigned long long m_misses;
+  unsigned long long m_evictions;
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <string>
+
+/**
+ * Per-request tracing. While a thread has a trace started, every TraceSpan
+ * on it is recorded; the finished trace is kept (the last 64 of them) and
+ * can be fetched as Chrome trace-event JSON, which chrome://tracing and
+ * Perfetto load as is.
+ *
+ * With no trace started a span costs a thread-local check and nothing
+ * more, so spans can go anywhere, the block layer included.
+ */
+class Trace {
+ public:
+  // Starts tracing what the calling thread does and returns the trace's id
+  static int start();
+  // Stops tracing and keeps the trace
+  static void finish();
+  static bool active();
+  // Microseconds on a monotonic clock: the timeline spans are placed on
+  static long long now();
+  // Records a span that has already ended. args is empty or arg()s joined
+  // with commas.
+  static void addSpan(const char *name, long long start, long long end,
+                      const std::string &args = "");
+  // "key":value, for addSpan
+  static std::string arg(const char *key, const std::string &value);
+  static std::string arg(const char *key, long long value);
+  // The trace-event JSON of trace id, or of every kept trace if id is
+  // negative. "" if id isn't kept.
+  static std::string json(int id);
+};
+
+// Records the time from its construction to its destruction as a span
+// named name, if the thread is being traced
+class TraceSpan {
+ public:
+  TraceSpan(const char *name) : m_name(name), m_active(Trace::active()) {
+    m_start = m_active ? Trace::now() : 0;
+  }
+  ~TraceSpan() {
+    if (m_active) {
+      Trace::addSpan(m_name, m_start, Trace::now(), m_args);
+    }
+  }
+  // Shown with the span. Only formatted when it is being recorded.
+  void arg(const char *key, const std::string &value);
+  void arg(const char *key, long long value);
+
+ private:
+  const char *m_name;
+  bool m_active;
+  long long m_start;
+  std::string m_args;
+};
+
+#endif
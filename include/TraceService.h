@@ -0,0 +1,16 @@
+#ifndef _TRACESERVICE_H_
+#define _TRACESERVICE_H_
+
+#include "HttpService.h"
+
+// GET /traces: the kept request traces as Chrome trace-event JSON, and
+// GET /traces/<id> just one of them. A request is traced when it has an
+// X-DS3-Trace header; its response then carries X-DS3-Trace-Id.
+class TraceService : public HttpService {
+ public:
+  TraceService();
+
+  virtual void get(HTTPRequest *request, HTTPResponse *response);
+};
+
+#endif
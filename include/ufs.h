@@ -26,6 +26,99 @@ typedef struct {
     int  inum;      // inode number of entry
 } dir_ent_t;
 
+// Directories on images with UFS_FEATURE_LONG_NAMES hold variable-length
+// records instead of dir_ent_t, ext2 style. Each record is a dir_rec_t
+// followed by name_len bytes of name (no \0) padded to a 4 byte boundary.
+// rec_len chains the records of a block and the last record in a block runs
+// to the end of it, so no record crosses a block. Records with inum == -1 are
+// free space. The size of such a directory is a multiple of UFS_BLOCK_SIZE.
+#define DIR_REC_MAX_NAME_LEN (255)
+typedef struct {
+    int inum;                // inode number of entry, -1 if free
+    unsigned int hash;       // ufs_name_hash() of the name, checked before the name
+    unsigned short rec_len;  // bytes from the start of this record to the next one
+    unsigned char name_len;  // bytes of name following the header
+    unsigned char pad;
+} dir_rec_t;
+
+// bytes a record needs for a name of name_len bytes
+#define DIR_REC_LEN(name_len) ((int) ((sizeof(dir_rec_t) + (name_len) + 3) & ~3))
+
+// FNV-1a, used as the lookup hash of long-name directory records
+static inline unsigned int ufs_name_hash(const char *name, int len) {
+    unsigned int hash = 2166136261u;
+    int i;
+    for (i = 0; i < len; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Optional features, recorded in super_t.features. Images made by an older
+// mkfs have the field zeroed and use the original layout throughout.
+#define UFS_FEATURE_LONG_NAMES (0x1)  // directories use dir_rec_t records
+#define UFS_FEATURE_INLINE_DATA (0x2) // small files live inside their inode
+#define UFS_FEATURE_SHARED_BLOCKS (0x4) // data blocks are reference counted
+#define UFS_FEATURE_DEDUP (0x8)         // identical file blocks are stored once
+#define UFS_FEATURE_COMPRESSION (0x10)  // file blocks are stored LZ4 compressed
+#define UFS_FEATURE_CHECKSUMS (0x20)    // file blocks are checksummed
+#define UFS_FEATURE_VERSIONS (0x40)     // files have a version and modification time
+
+// On images with UFS_FEATURE_INLINE_DATA, a regular file of at most
+// UFS_INLINE_DATA_SIZE bytes keeps its contents in the direct[] array of its
+// inode rather than in a data block. The size alone tells the two apart.
+#define UFS_INLINE_DATA_SIZE ((int) (DIRECT_PTRS * sizeof(unsigned int)))
+#define UFS_HAS_INLINE_DATA(super, inode)                  \
+    (((super)->features & UFS_FEATURE_INLINE_DATA) &&      \
+     (inode)->type == UFS_REGULAR_FILE &&                  \
+     (inode)->size <= UFS_INLINE_DATA_SIZE)
+
+// On images with UFS_FEATURE_SHARED_BLOCKS a refcount region sits between
+// the inode region and the data region. It holds one unsigned int per data
+// block counting the references beyond the first, so a zeroed region means
+// every allocated block has a single owner. A block with a nonzero count is
+// shared by several files and is copied before any of them changes it.
+#define UFS_REFCOUNTS_PER_BLOCK ((int) (UFS_BLOCK_SIZE / sizeof(unsigned int)))
+
+// On images with UFS_FEATURE_DEDUP (which also sets UFS_FEATURE_SHARED_BLOCKS)
+// a fingerprint region follows the refcount region, one XXH64 (seed 0) of the
+// block contents per data block. Only blocks of regular files are looked up
+// there and a match is compared byte for byte before it is shared, so a
+// stale fingerprint is never trusted.
+#define UFS_FINGERPRINTS_PER_BLOCK ((int) (UFS_BLOCK_SIZE / sizeof(unsigned long long)))
+
+// Images with UFS_FEATURE_COMPRESSION or UFS_FEATURE_VERSIONS have an inode
+// extension region after the fingerprint region, one inode_ext_t per inode,
+// for metadata that does not fit in inode_t.
+//
+// A compressed file (UFS_INODE_COMPRESSED) compresses each 4 KB logical block
+// on its own and packs the results back to back across its data blocks, so
+// logical block i starts at the sum of clen[0..i-1] bytes into them. A block
+// that doesn't shrink is stored as is, which shows as clen[i] equal to its
+// logical length. The file has fewer data blocks than its size implies and
+// the direct[] entries past the last one are 0.
+//
+// On images with UFS_FEATURE_VERSIONS, version and mtime identify what a file
+// holds, for HTTP validators. The version of a reused inode carries on from
+// its last owner, so (inode number, version) never names two contents.
+#define UFS_INODE_COMPRESSED (0x1)
+typedef struct {
+    int flags;                         // UFS_INODE_* bits
+    unsigned short clen[DIRECT_PTRS];  // stored bytes of each logical block
+    unsigned long long version;        // bumped by every create, write, append and copy
+    long long mtime;                   // time of the last bump, seconds since the epoch
+    unsigned char reserved[48];        // room for later per-inode metadata
+} inode_ext_t;
+
+// Images with UFS_FEATURE_CHECKSUMS have a checksum region after the inode
+// extension region, one CRC-32C per data block. Every write of a file block
+// records the checksum of what went to disk and reads of file blocks check
+// it. Only blocks regular files point at are ever checked, so the stale
+// entries of freed blocks and the (unchecksummed) directory blocks don't
+// matter. A CRC that comes out as 0 is stored as 1: 0 means "no checksum".
+#define UFS_CHECKSUMS_PER_BLOCK ((int) (UFS_BLOCK_SIZE / sizeof(unsigned int)))
+
 // presumed: block 0 is the super block
 typedef struct __super {
     int inode_bitmap_addr; // block address (in blocks)
@@ -38,6 +131,15 @@ typedef struct __super {
     int data_region_len;   // in blocks
     int num_inodes;        // just the number of inodes
     int num_data;          // and data blocks...
+    int features;          // UFS_FEATURE_* bits
+    int refcount_addr;     // block address (in blocks), UFS_FEATURE_SHARED_BLOCKS only
+    int refcount_len;      // in blocks
+    int fingerprint_addr;  // block address (in blocks), UFS_FEATURE_DEDUP only
+    int fingerprint_len;   // in blocks
+    int inode_ext_addr;    // block address (in blocks), UFS_FEATURE_COMPRESSION or _VERSIONS only
+    int inode_ext_len;     // in blocks
+    int checksum_addr;     // block address (in blocks), UFS_FEATURE_CHECKSUMS only
+    int checksum_len;      // in blocks
 } super_t;
 
 
@@ -0,0 +1,327 @@
+#include <stdlib.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <pthread.h>
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "HttpClient.h"
+#include "HTTPClientResponse.h"
+
+using namespace std;
+
+// loadgen: a closed-loop load generator for gunrock_web. Each of the -c
+// threads sends a request, waits for the answer and sends the next, for
+// -t seconds or until -n requests have gone out. Requests are a GET, PUT
+// and DELETE mix over -k keys under -P, picked uniformly or with a Zipf
+// distribution, or are replayed from a file of "METHOD TARGET [BYTES]"
+// lines such as gunrock_web prints for every request. Prints throughput, latency
+// percentiles and status counts for each method.
+
+typedef enum {GET, PUT, DELETE, NUM_OPS} Op;
+static const char *opNames[NUM_OPS] = {"GET", "PUT", "DELETE"};
+
+struct Request {
+  Op op;
+  string path;
+  int size;
+};
+
+string HOST = "localhost";
+int PORT = 8080;
+int CONCURRENCY = 4;
+int DURATION = 10;
+long MAX_REQUESTS = 0;  // 0: no limit, just the duration
+int MIX[NUM_OPS] = {80, 15, 5};
+int KEYS = 1000;
+double ZIPF = 0;        // 0: uniform
+int MIN_SIZE = 4096;
+int MAX_SIZE = 4096;
+string PREFIX = "/ds3/load";
+string REPLAY_FILE;
+
+static vector<Request> replay;
+static long replaySkipped = 0;  // lines naming requests loadgen can't send
+static vector<double> zipfCdf;
+static atomic<long> issued(0);
+static chrono::steady_clock::time_point deadline;
+
+struct ThreadStats {
+  vector<double> micros[NUM_OPS];
+  map<int, long> statuses[NUM_OPS];  // status 0: the connection failed
+};
+
+static string keyPath(int key) {
+  return PREFIX + "/k" + to_string(key);
+}
+
+// Picks key i with probability proportional to 1 / (i + 1)^ZIPF
+static int pickKey(mt19937_64 &rng) {
+  if (ZIPF <= 0) {
+    return uniform_int_distribution<int>(0, KEYS - 1)(rng);
+  }
+  double u = uniform_real_distribution<double>(0, 1)(rng);
+  return lower_bound(zipfCdf.begin(), zipfCdf.end(), u) - zipfCdf.begin();
+}
+
+static Request nextRequest(mt19937_64 &rng) {
+  Request request;
+  int roll = uniform_int_distribution<int>(0, MIX[GET] + MIX[PUT] + MIX[DELETE] - 1)(rng);
+  request.op = roll < MIX[GET] ? GET : roll < MIX[GET] + MIX[PUT] ? PUT : DELETE;
+  request.path = keyPath(pickKey(rng));
+  request.size = request.op == PUT ? uniform_int_distribution<int>(MIN_SIZE, MAX_SIZE)(rng) : 0;
+  return request;
+}
+
+// Sends request on a pooled keep-alive connection, or a new one, and
+// returns the status, 0 if the connection failed
+static int send(const Request &request, const string &body) {
+  try {
+    HttpClient client(HOST.c_str(), PORT);
+    HTTPClientResponse *response;
+    if (request.op == GET) {
+      response = client.get(request.path);
+    } else if (request.op == PUT) {
+      response = client.put(request.path, body.substr(0, request.size));
+    } else {
+      response = client.del(request.path);
+    }
+    int status = response->status();
+    delete response;
+    return status;
+  } catch (...) {
+    return 0;
+  }
+}
+
+static bool claimRequest() {
+  if (chrono::steady_clock::now() >= deadline) {
+    return false;
+  }
+  return MAX_REQUESTS == 0 || issued.fetch_add(1) < MAX_REQUESTS;
+}
+
+struct Worker {
+  int id;
+  ThreadStats stats;
+};
+
+static void *runWorker(void *arg) {
+  Worker *worker = (Worker *) arg;
+  mt19937_64 rng(worker->id * 7919 + 1);
+  string body(MAX_SIZE, 'x');
+
+  size_t next = worker->id;  // replay: every CONCURRENCY'th line from here
+  while (claimRequest()) {
+    Request request;
+    if (!replay.empty()) {
+      if (next >= replay.size()) {
+        break;
+      }
+      request = replay[next];
+      next += CONCURRENCY;
+      if ((int) body.size() < request.size) {
+        body.resize(request.size, 'x');
+      }
+    } else {
+      request = nextRequest(rng);
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    int status = send(request, body);
+    double micros = chrono::duration<double, micro>(chrono::steady_clock::now() - start).count();
+    worker->stats.micros[request.op].push_back(micros);
+    worker->stats.statuses[request.op][status]++;
+  }
+  return NULL;
+}
+
+static void loadReplay(const string &file) {
+  ifstream in(file);
+  if (!in) {
+    cerr << "loadgen: could not open " << file << endl;
+    exit(1);
+  }
+  string line;
+  while (getline(in, line)) {
+    stringstream fields(line);
+    string method;
+    Request request;
+    request.size = MIN_SIZE;
+    if (!(fields >> method >> request.path) || request.path[0] != '/') {
+      continue;  // not a request line
+    }
+    fields >> request.size;
+    string extra;
+    if (fields >> extra) {
+      replaySkipped++;  // a copy, whose source header loadgen doesn't send
+      continue;
+    }
+    if (method == "GET") {
+      request.op = GET;
+    } else if (method == "PUT") {
+      request.op = PUT;
+    } else if (method == "DELETE") {
+      request.op = DELETE;
+    } else {
+      replaySkipped++;  // HEAD, MOVE, or a POST whose body wasn't logged
+      continue;
+    }
+    replay.push_back(request);
+  }
+}
+
+static double percentile(const vector<double> &sorted, double p) {
+  return sorted[min(sorted.size() - 1, (size_t) (p * sorted.size()))];
+}
+
+static void report(const string &name, vector<double> &micros, const map<int, long> &statuses,
+                   double seconds) {
+  if (micros.empty()) {
+    return;
+  }
+  sort(micros.begin(), micros.end());
+  double total = 0;
+  for (double m : micros) {
+    total += m;
+  }
+  printf("%-7s %8zu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f  ", name.c_str(), micros.size(),
+         micros.size() / seconds, total / micros.size(), percentile(micros, 0.5),
+         percentile(micros, 0.9), percentile(micros, 0.99), percentile(micros, 0.999), micros.back());
+  for (const pair<const int, long> &status : statuses) {
+    printf(" %d:%ld", status.first, status.second);
+  }
+  printf("\n");
+}
+
+static void usage(const char *name) {
+  cerr << "usage: " << name << " [-h host] [-p port] [-c concurrency] [-t seconds] [-n requests]"
+       << " [-m get:put:delete] [-k keys] [-z zipfExponent] [-s bytes|min-max] [-P pathPrefix]"
+       << " [-r replayFile]" << endl;
+  exit(1);
+}
+
+int main(int argc, char *argv[]) {
+  int option;
+  while ((option = getopt(argc, argv, "h:p:c:t:n:m:k:z:s:P:r:")) != -1) {
+    switch (option) {
+    case 'h':
+      HOST = optarg;
+      break;
+    case 'p':
+      PORT = atoi(optarg);
+      break;
+    case 'c':
+      CONCURRENCY = atoi(optarg);
+      break;
+    case 't':
+      DURATION = atoi(optarg);
+      break;
+    case 'n':
+      MAX_REQUESTS = atol(optarg);
+      break;
+    case 'm':
+      if (sscanf(optarg, "%d:%d:%d", &MIX[GET], &MIX[PUT], &MIX[DELETE]) != 3 ||
+          MIX[GET] < 0 || MIX[PUT] < 0 || MIX[DELETE] < 0 || MIX[GET] + MIX[PUT] + MIX[DELETE] == 0) {
+        usage(argv[0]);
+      }
+      break;
+    case 'k':
+      KEYS = atoi(optarg);
+      break;
+    case 'z':
+      ZIPF = atof(optarg);
+      break;
+    case 's':
+      if (sscanf(optarg, "%d-%d", &MIN_SIZE, &MAX_SIZE) != 2) {
+        MAX_SIZE = MIN_SIZE = atoi(optarg);
+      }
+      break;
+    case 'P':
+      PREFIX = optarg;
+      break;
+    case 'r':
+      REPLAY_FILE = optarg;
+      break;
+    default:
+      usage(argv[0]);
+    }
+  }
+  if (CONCURRENCY <= 0 || KEYS <= 0 || MIN_SIZE < 0 || MAX_SIZE < MIN_SIZE) {
+    usage(argv[0]);
+  }
+
+  if (!REPLAY_FILE.empty()) {
+    loadReplay(REPLAY_FILE);
+    cout << "replaying " << replay.size() << " requests from " << REPLAY_FILE << ", skipping "
+         << replaySkipped << " it can't send" << endl;
+  } else {
+    if (ZIPF > 0) {
+      double sum = 0;
+      for (int key = 0; key < KEYS; key++) {
+        sum += 1 / pow(key + 1, ZIPF);
+        zipfCdf.push_back(sum);
+      }
+      for (double &p : zipfCdf) {
+        p /= sum;
+      }
+    }
+
+    // Every key exists before the run, so GETs measure reads and not 404s
+    if (MIX[GET] > 0) {
+      cout << "creating " << KEYS << " keys under " << PREFIX << endl;
+      string body(MAX_SIZE, 'x');
+      for (int key = 0; key < KEYS; key++) {
+        Request request = {PUT, keyPath(key), MAX_SIZE};
+        if (send(request, body) != 200) {
+          cerr << "loadgen: could not create " << request.path << endl;
+          return 1;
+        }
+      }
+    }
+  }
+
+  vector<Worker> workers(CONCURRENCY);
+  vector<pthread_t> threads(CONCURRENCY);
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  deadline = start + chrono::seconds(DURATION);
+  for (int idx = 0; idx < CONCURRENCY; idx++) {
+    workers[idx].id = idx;
+    pthread_create(&threads[idx], NULL, runWorker, &workers[idx]);
+  }
+  for (int idx = 0; idx < CONCURRENCY; idx++) {
+    pthread_join(threads[idx], NULL);
+  }
+  double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+  printf("%d threads, %.1f s\n", CONCURRENCY, seconds);
+  printf("%-7s %8s %9s %9s %9s %9s %9s %9s %9s   %s\n", "op", "requests", "req/sec", "mean us",
+         "p50 us", "p90 us", "p99 us", "p999 us", "max us", "status:count (0: no connection)");
+  vector<double> all;
+  map<int, long> allStatuses;
+  for (int op = 0; op < NUM_OPS; op++) {
+    vector<double> micros;
+    map<int, long> statuses;
+    for (Worker &worker : workers) {
+      micros.insert(micros.end(), worker.stats.micros[op].begin(), worker.stats.micros[op].end());
+      for (const pair<const int, long> &status : worker.stats.statuses[op]) {
+        statuses[status.first] += status.second;
+        allStatuses[status.first] += status.second;
+      }
+    }
+    all.insert(all.end(), micros.begin(), micros.end());
+    report(opNames[op], micros, statuses, seconds);
+  }
+  report("all", all, allStatuses, seconds);
+  return 0;
+}
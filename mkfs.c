@@ -8,7 +8,14 @@
 #include "ufs.h"
 
 void usage() {
-    fprintf(stderr, "usage: mkfs -f <image_file> [-d <num_data_blocks] [-i <num_inodes>]\n");
+    fprintf(stderr, "usage: mkfs -f <image_file> [-d <num_data_blocks] [-i <num_inodes>] [-l] [-s] [-c] [-u] [-z] [-k] [-e]\n");
+    fprintf(stderr, "  -l  use long (up to %d byte) file names\n", DIR_REC_MAX_NAME_LEN);
+    fprintf(stderr, "  -s  store files of up to %d bytes inside their inode\n", UFS_INLINE_DATA_SIZE);
+    fprintf(stderr, "  -c  reference count data blocks so copies can share them\n");
+    fprintf(stderr, "  -u  store identical file blocks once (implies -c)\n");
+    fprintf(stderr, "  -z  compress file blocks\n");
+    fprintf(stderr, "  -k  checksum file blocks\n");
+    fprintf(stderr, "  -e  keep a version and modification time for each file\n");
     exit(1);
 }
 
@@ -18,8 +25,9 @@ int main(int argc, char *argv[]) {
     int num_inodes = 32;
     int num_data = 32;
     int visual = 0;
+    int features = 0;
 
-    while ((ch = getopt(argc, argv, "i:d:f:v")) != -1) {
+    while ((ch = getopt(argc, argv, "i:d:f:vlscuzke")) != -1) {
 	switch (ch) {
 	case 'i':
 	    num_inodes = atoi(optarg);
@@ -33,6 +41,27 @@ int main(int argc, char *argv[]) {
 	case 'v':
 	    visual = 1;
 	    break;
+	case 'l':
+	    features |= UFS_FEATURE_LONG_NAMES;
+	    break;
+	case 's':
+	    features |= UFS_FEATURE_INLINE_DATA;
+	    break;
+	case 'c':
+	    features |= UFS_FEATURE_SHARED_BLOCKS;
+	    break;
+	case 'u':
+	    features |= UFS_FEATURE_DEDUP | UFS_FEATURE_SHARED_BLOCKS;
+	    break;
+	case 'z':
+	    features |= UFS_FEATURE_COMPRESSION;
+	    break;
+	case 'k':
+	    features |= UFS_FEATURE_CHECKSUMS;
+	    break;
+	case 'e':
+	    features |= UFS_FEATURE_VERSIONS;
+	    break;
 	default:
 	    usage();
 	}
@@ -65,6 +94,7 @@ int main(int argc, char *argv[]) {
     // totals
     s.num_inodes = num_inodes;
     s.num_data = num_data;
+    s.features = features;
 
     // inode bitmap
     int bits_per_block = (8 * UFS_BLOCK_SIZE); // remember, there are 8 bits per byte
@@ -87,11 +117,55 @@ int main(int argc, char *argv[]) {
     if (total_inode_bytes % UFS_BLOCK_SIZE != 0)
 	s.inode_region_len++;
 
+    // block reference counts
+    s.refcount_addr = 0;
+    s.refcount_len = 0;
+    if (features & UFS_FEATURE_SHARED_BLOCKS) {
+	s.refcount_addr = s.inode_region_addr + s.inode_region_len;
+	s.refcount_len = num_data / UFS_REFCOUNTS_PER_BLOCK;
+	if (num_data % UFS_REFCOUNTS_PER_BLOCK != 0)
+	    s.refcount_len++;
+    }
+
+    // block fingerprints
+    s.fingerprint_addr = 0;
+    s.fingerprint_len = 0;
+    if (features & UFS_FEATURE_DEDUP) {
+	s.fingerprint_addr = s.refcount_addr + s.refcount_len;
+	s.fingerprint_len = num_data / UFS_FINGERPRINTS_PER_BLOCK;
+	if (num_data % UFS_FINGERPRINTS_PER_BLOCK != 0)
+	    s.fingerprint_len++;
+    }
+
+    // inode extensions
+    s.inode_ext_addr = 0;
+    s.inode_ext_len = 0;
+    if (features & (UFS_FEATURE_COMPRESSION | UFS_FEATURE_VERSIONS)) {
+	int total_ext_bytes = num_inodes * sizeof(inode_ext_t);
+	s.inode_ext_addr = s.inode_region_addr + s.inode_region_len + s.refcount_len + s.fingerprint_len;
+	s.inode_ext_len = total_ext_bytes / UFS_BLOCK_SIZE;
+	if (total_ext_bytes % UFS_BLOCK_SIZE != 0)
+	    s.inode_ext_len++;
+    }
+
+    // block checksums
+    s.checksum_addr = 0;
+    s.checksum_len = 0;
+    if (features & UFS_FEATURE_CHECKSUMS) {
+	s.checksum_addr = s.inode_region_addr + s.inode_region_len + s.refcount_len + s.fingerprint_len +
+	    s.inode_ext_len;
+	s.checksum_len = num_data / UFS_CHECKSUMS_PER_BLOCK;
+	if (num_data % UFS_CHECKSUMS_PER_BLOCK != 0)
+	    s.checksum_len++;
+    }
+
     // data blocks
-    s.data_region_addr = s.inode_region_addr + s.inode_region_len;
+    s.data_region_addr = s.inode_region_addr + s.inode_region_len + s.refcount_len + s.fingerprint_len +
+	s.inode_ext_len + s.checksum_len;
     s.data_region_len = num_data;
 
-    int total_blocks = 1 + s.inode_bitmap_len + s.data_bitmap_len + s.inode_region_len + s.data_region_len;
+    int total_blocks = 1 + s.inode_bitmap_len + s.data_bitmap_len + s.inode_region_len + s.refcount_len +
+	s.fingerprint_len + s.inode_ext_len + s.checksum_len + s.data_region_len;
 
     // super block is the first block
     int rc = pwrite(fd, &s, sizeof(super_t), 0);
@@ -106,6 +180,16 @@ int main(int argc, char *argv[]) {
     printf("layout details\n");
     printf("  inode bitmap address/len %d [%d]\n", s.inode_bitmap_addr, s.inode_bitmap_len);
     printf("  data bitmap address/len  %d [%d]\n", s.data_bitmap_addr, s.data_bitmap_len);
+    if (s.refcount_len != 0)
+	printf("  refcount address/len     %d [%d]\n", s.refcount_addr, s.refcount_len);
+    if (s.fingerprint_len != 0)
+	printf("  fingerprint address/len  %d [%d]\n", s.fingerprint_addr, s.fingerprint_len);
+    if (s.inode_ext_len != 0)
+	printf("  inode ext address/len    %d [%d]\n", s.inode_ext_addr, s.inode_ext_len);
+    if (s.checksum_len != 0)
+	printf("  checksum address/len     %d [%d]\n", s.checksum_addr, s.checksum_len);
+    if (s.features != 0)
+	printf("  features                 0x%x\n", s.features);
 
     // first, zero out all the blocks
     int i;
@@ -150,7 +234,10 @@ int main(int argc, char *argv[]) {
 
     inode_block itable;
     itable.inodes[0].type = UFS_DIRECTORY;
-    itable.inodes[0].size = 2 * sizeof(dir_ent_t); // in bytes
+    if (features & UFS_FEATURE_LONG_NAMES)
+	itable.inodes[0].size = UFS_BLOCK_SIZE; // long-name directories are whole blocks
+    else
+	itable.inodes[0].size = 2 * sizeof(dir_ent_t); // in bytes
     itable.inodes[0].direct[0] = s.data_region_addr;
     for (i = 1; i < DIRECT_PTRS; i++)
 	itable.inodes[0].direct[i] = -1;
@@ -178,6 +265,28 @@ int main(int argc, char *argv[]) {
     for (i = 2; i < 128; i++)
 	parent.entries[i].inum = -1;
 
+    if (features & UFS_FEATURE_LONG_NAMES) {
+	// same directory as variable-length records: ".", then ".." running
+	// to the end of the block
+	unsigned char *block = (unsigned char *) &parent;
+	dir_rec_t rec;
+	memset(block, 0, UFS_BLOCK_SIZE);
+
+	rec.inum = 0;
+	rec.hash = ufs_name_hash(".", 1);
+	rec.rec_len = DIR_REC_LEN(1);
+	rec.name_len = 1;
+	rec.pad = 0;
+	memcpy(block, &rec, sizeof(rec));
+	memcpy(block + sizeof(rec), ".", 1);
+
+	rec.hash = ufs_name_hash("..", 2);
+	rec.rec_len = UFS_BLOCK_SIZE - DIR_REC_LEN(1);
+	rec.name_len = 2;
+	memcpy(block + DIR_REC_LEN(1), &rec, sizeof(rec));
+	memcpy(block + DIR_REC_LEN(1) + sizeof(rec), "..", 2);
+    }
+
     rc = pwrite(fd, &parent, UFS_BLOCK_SIZE, s.data_region_addr * UFS_BLOCK_SIZE);
     assert(rc == UFS_BLOCK_SIZE);
 
@@ -191,6 +300,14 @@ int main(int argc, char *argv[]) {
 	    printf("d");
 	for (i = 0; i < s.inode_region_len; i++)
 	    printf("I");
+	for (i = 0; i < s.refcount_len; i++)
+	    printf("R");
+	for (i = 0; i < s.fingerprint_len; i++)
+	    printf("F");
+	for (i = 0; i < s.inode_ext_len; i++)
+	    printf("X");
+	for (i = 0; i < s.checksum_len; i++)
+	    printf("C");
 	for (i = 0; i < s.data_region_len; i++)
 	    printf("D");
 	printf("\n\n");
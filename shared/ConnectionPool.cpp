@@ -0,0 +1,81 @@
+#include "ConnectionPool.h"
+
+using namespace std;
+
+#define RESPONSE_BUFFER_SIZE (16 * 1024)
+
+static string poolKey(const string &host, int port) {
+  return host + ":" + to_string(port);
+}
+
+void HttpConnection::close() {
+  delete socket;
+  delete buffer;
+  socket = NULL;
+  buffer = NULL;
+}
+
+ConnectionPool::ConnectionPool(int maxIdlePerHost) {
+  m_maxIdlePerHost = maxIdlePerHost;
+  pthread_mutex_init(&m_lock, NULL);
+}
+
+ConnectionPool::~ConnectionPool() {
+  for (auto &idle : m_idle) {
+    for (HttpConnection &connection : idle.second) {
+      connection.close();
+    }
+  }
+  pthread_mutex_destroy(&m_lock);
+}
+
+HttpConnection ConnectionPool::acquire(const string &host, int port) {
+  string key = poolKey(host, port);
+  while (true) {
+    pthread_mutex_lock(&m_lock);
+    vector<HttpConnection> &idle = m_idle[key];
+    if (idle.empty()) {
+      pthread_mutex_unlock(&m_lock);
+      break;
+    }
+    HttpConnection connection = idle.back();
+    idle.pop_back();
+    pthread_mutex_unlock(&m_lock);
+
+    // The server may have hung up while it sat here
+    if (connection.buffer->size() == 0 && !connection.socket->stale()) {
+      connection.reused = true;
+      return connection;
+    }
+    connection.close();
+  }
+  return connect(host, port);
+}
+
+HttpConnection ConnectionPool::connect(const string &host, int port) {
+  HttpConnection connection;
+  connection.socket = new MySocket(host.c_str(), port);
+  connection.buffer = new SocketBuffer(RESPONSE_BUFFER_SIZE);
+  connection.reused = false;
+  return connection;
+}
+
+void ConnectionPool::release(const string &host, int port, HttpConnection connection) {
+  pthread_mutex_lock(&m_lock);
+  vector<HttpConnection> &idle = m_idle[poolKey(host, port)];
+  if ((int) idle.size() < m_maxIdlePerHost) {
+    idle.push_back(connection);
+    connection.socket = NULL;
+  }
+  pthread_mutex_unlock(&m_lock);
+
+  if (connection.socket != NULL) {
+    connection.close();
+  }
+}
+
+ConnectionPool *ConnectionPool::global() {
+  // Never destroyed, so threads still running at exit can use it
+  static ConnectionPool *pool = new ConnectionPool();
+  return pool;
+}
@@ -0,0 +1,67 @@
+#include <string.h>
+
+#include "Crc32c.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <nmmintrin.h>
+#define HAVE_SSE42_CRC 1
+#endif
+
+// reflected Castagnoli polynomial
+#define POLY 0x82f63b78u
+
+static uint32_t table[256];
+
+static bool buildTable() {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t crc = i;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (POLY & (0 - (crc & 1)));
+    }
+    table[i] = crc;
+  }
+  return true;
+}
+
+static uint32_t softwareCrc(uint32_t crc, const uint8_t *p, size_t len) {
+  static bool built = buildTable();
+  (void) built;
+  while (len-- > 0) {
+    crc = table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+#ifdef HAVE_SSE42_CRC
+// Built for SSE 4.2 on its own so the rest of the tree needs no -msse4.2;
+// only called once the CPU is known to have it
+__attribute__((target("sse4.2")))
+static uint32_t hardwareCrc(uint32_t crc, const uint8_t *p, size_t len) {
+#ifdef __x86_64__
+  uint64_t crc64 = crc;
+  while (len >= 8) {
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    crc64 = _mm_crc32_u64(crc64, v);
+    p += 8;
+    len -= 8;
+  }
+  crc = (uint32_t) crc64;
+#endif
+  while (len-- > 0) {
+    crc = _mm_crc32_u8(crc, *p++);
+  }
+  return crc;
+}
+#endif
+
+uint32_t Crc32c::compute(const void *data, size_t len) {
+  const uint8_t *p = (const uint8_t *) data;
+#ifdef HAVE_SSE42_CRC
+  static bool hardware = __builtin_cpu_supports("sse4.2");
+  if (hardware) {
+    return ~hardwareCrc(~0u, p, len);
+  }
+#endif
+  return ~softwareCrc(~0u, p, len);
+}
@@ -0,0 +1,32 @@
+#include <zlib.h>
+
+#include <stdexcept>
+
+#include "Gzip.h"
+
+using namespace std;
+
+// deflateInit2 writes a gzip header and trailer instead of a zlib one when
+// 16 is added to the window bits
+#define GZIP_WINDOW_BITS (15 + 16)
+
+string Gzip::compress(const void *data, size_t len, int level) {
+  z_stream stream = {};
+  if (deflateInit2(&stream, level, Z_DEFLATED, GZIP_WINDOW_BITS, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    throw runtime_error("deflateInit2 failed");
+  }
+
+  // deflateBound is enough for all of it in one call
+  string out(deflateBound(&stream, len), '\0');
+  stream.next_in = (Bytef *) data;
+  stream.avail_in = len;
+  stream.next_out = (Bytef *) &out[0];
+  stream.avail_out = out.size();
+  int ret = deflate(&stream, Z_FINISH);
+  out.resize(stream.total_out);
+  deflateEnd(&stream);
+  if (ret != Z_STREAM_END) {
+    throw runtime_error("deflate failed");
+  }
+  return out;
+}
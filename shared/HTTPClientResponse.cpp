@@ -5,48 +5,180 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
 
 #include <sstream>
 
 using namespace std;
 
-HTTPClientResponse::HTTPClientResponse(MySocket *sock) {
+HTTPClientResponse::HTTPClientResponse(MySocket *sock, SocketBuffer *buffer) {
     m_sock = sock;
+    m_owns_buffer = buffer == NULL;
+    m_buffer = m_owns_buffer ? new SocketBuffer(16 * 1024) : buffer;
     m_status_code = 0;
+    m_keep_alive = false;
+    m_bytes_read = 0;
 }
 
+HTTPClientResponse::~HTTPClientResponse() {
+  if (m_owns_buffer) {
+    delete m_buffer;
+  }
+}
 
-string HTTPClientResponse::readResponse() {
-  string full_response;
+static string lowercase(string str) {
+  for (char &c : str) {
+    c = tolower(c);
+  }
+  return str;
+}
 
+static string trim(const string &str) {
+  size_t start = str.find_first_not_of(" \t\r\n");
+  size_t end = str.find_last_not_of(" \t\r\n");
+  return start == string::npos ? "" : str.substr(start, end - start + 1);
+}
+
+string HTTPClientResponse::header(string name) {
+  map<string, string>::iterator iter = m_headers.find(lowercase(name));
+  return iter == m_headers.end() ? "" : iter->second;
+}
+
+// More bytes into the buffer; false once the connection is done
+bool HTTPClientResponse::fill() {
+  try {
+    m_bytes_read += m_buffer->fill(m_sock);
+    return true;
+  } catch (...) {
+    return false;
+  }
+}
+
+// The next line, without its line ending
+bool HTTPClientResponse::readLine(string &line) {
+  line.clear();
   while (true) {
-    string response;
-    try {
-      response = m_sock->read();
-    } catch (...) {
-      break;
+    size_t len;
+    const char *data = m_buffer->data(&len);
+    const char *newline = (const char *) memchr(data, '\n', len);
+    if (newline != NULL) {
+      line.append(data, newline - data);
+      m_buffer->consume(newline - data + 1);
+      if (!line.empty() && line[line.size() - 1] == '\r') {
+        line.resize(line.size() - 1);
+      }
+      return true;
+    }
+    line.append(data, len);
+    m_buffer->consume(len);
+    if (!fill()) {
+      return false;
     }
-
-    full_response += response;
   }
+}
 
-  size_t delimiter = full_response.find("\r\n\r\n");
-  if (delimiter == string::npos) {
-    return "";
+// Appends len more bytes of body
+bool HTTPClientResponse::readBytes(size_t len) {
+  while (len > 0) {
+    size_t available;
+    const char *data = m_buffer->data(&available);
+    if (available == 0) {
+      if (!fill()) {
+        return false;
+      }
+      continue;
+    }
+    size_t take = min(len, available);
+    m_body.append(data, take);
+    m_buffer->consume(take);
+    len -= take;
   }
+  return true;
+}
 
-  m_body = full_response.substr(delimiter+4);
-  string header_string = full_response.substr(0, delimiter);
-  stringstream header_stream(header_string);
+bool HTTPClientResponse::readChunked() {
+  string line;
+  while (true) {
+    if (!readLine(line)) {
+      return false;
+    }
+    // The size is hex and may be followed by ;extensions
+    size_t size = strtoul(line.c_str(), NULL, 16);
+    if (size == 0) {
+      break;
+    }
+    if (!readBytes(size) || !readLine(line)) {
+      return false;
+    }
+  }
+  // Trailers, up to a blank line
+  do {
+    if (!readLine(line)) {
+      return false;
+    }
+  } while (!line.empty());
+  return true;
+}
 
+// The status line and headers, skipping any 100 Continue
+bool HTTPClientResponse::readHead() {
   string line;
-  while (getline(header_stream, line)) {
-    if (line.find("HTTP/1.1 ") == 0 || line.find("HTTP/1.0") == 0) {
-      stringstream header_line(line);
-      string http;
-      header_line >> http >> m_status_code >> m_status_message;
+  do {
+    m_headers.clear();
+    if (!readLine(line)) {
+      return false;
     }
+    stringstream status_line(line);
+    status_line >> m_version >> m_status_code;
+    getline(status_line, m_status_message);
+    m_status_message = trim(m_status_message);
+
+    while (true) {
+      if (!readLine(line)) {
+        return false;
+      }
+      if (line.empty()) {
+        break;
+      }
+      size_t colon = line.find(':');
+      if (colon != string::npos) {
+        m_headers[lowercase(trim(line.substr(0, colon)))] = trim(line.substr(colon + 1));
+      }
+    }
+  } while (m_status_code >= 100 && m_status_code < 200);
+  return m_status_code != 0;
+}
+
+string HTTPClientResponse::readResponse() {
+  m_keep_alive = false;
+  if (!readHead()) {
+    return "";
   }
-  
+
+  bool framed = true;
+  if (m_status_code == 204 || m_status_code == 304) {
+    // never a body
+  } else if (lowercase(header("Transfer-Encoding")).find("chunked") != string::npos) {
+    framed = readChunked();
+  } else if (m_headers.count("content-length")) {
+    framed = readBytes(strtoull(header("Content-Length").c_str(), NULL, 10));
+  } else {
+    // The body runs to the end of the connection
+    while (true) {
+      size_t len;
+      const char *data = m_buffer->data(&len);
+      m_body.append(data, len);
+      m_buffer->consume(len);
+      if (!fill()) {
+        break;
+      }
+    }
+    framed = false;
+  }
+
+  string connection = lowercase(header("Connection"));
+  m_keep_alive = framed && (m_version == "HTTP/1.1" ? connection != "close" : connection == "keep-alive");
   return m_body;
 }
@@ -15,19 +15,28 @@ HttpClient::HttpClient(const char *inet_addr, int port, bool use_tls) {
     cerr << "Removed SSL sockets for now" << endl;
     exit(1);
   } else {
-    connection = new MySocket(inet_addr, port);
+    connection = ConnectionPool::global()->acquire(inet_addr, port);
   }
+  this->host = inet_addr;
+  this->port = port;
+  this->pending = 0;
   
   stringstream host;
   host << inet_addr << ":" << port;
   headers["Host"] = host.str();
   headers["User-Agent"] = string("Gunrock/1.0");
   headers["Accept"] = string("*/*");
-  headers["Connection"] = string("close");
+  headers["Connection"] = string("keep-alive");
 }
 
 HttpClient::~HttpClient() {
-  delete connection;
+  if (connection.socket != NULL) {
+    if (pending) {
+      connection.close();
+    } else {
+      ConnectionPool::global()->release(host, port, connection);
+    }
+  }
 }
 
 void HttpClient::set_header(string key, string value) {
@@ -42,14 +51,16 @@ void HttpClient::set_basic_auth(string username, string password) {
 }
 
 void HttpClient::write_request(string path, string method, string body) {
+  write_request(path, method, body.data(), body.size());
+}
+
+void HttpClient::write_request(string path, string method, const char *body, size_t length) {
   stringstream request;
 
   // PART 1: implement support for handling the body, if it exists
   request << method << " " << path << " HTTP/1.1\r\n";
-  if (body.size() > 0) {
-    stringstream length;
-    length << body.size();
-    headers["Content-Length"] = length.str();
+  if (length > 0) {
+    headers["Content-Length"] = to_string(length);
   } else {
     headers.erase("Content-Length");
   }
@@ -60,38 +71,67 @@ void HttpClient::write_request(string path, string method, string body) {
   } 
   
   request << "\r\n";
+  string head = request.str();
 
-  if (body.size() > 0) {
-    request << body;
+  if (connection.socket == NULL) {
+    connection = ConnectionPool::global()->acquire(host, port);
   }
-  
-  connection->write(request.str());
+  pending++;
+  struct iovec iov[2] = {{(void *) head.data(), head.size()}, {(void *) body, length}};
+  connection.socket->writev(iov, length > 0 ? 2 : 1);
 }
 
 
 
 HTTPClientResponse *HttpClient::read_response() {
-  HTTPClientResponse *response = new HTTPClientResponse(connection);
+  HTTPClientResponse *response = new HTTPClientResponse(connection.socket, connection.buffer);
   response->readResponse();
+  pending--;
+  if (!response->keepAlive()) {
+    connection.close();
+    pending = 0;
+  }
   return response;
 }
 
-HTTPClientResponse *HttpClient::get(string path) {
-  write_request(path, "GET", "");
+HTTPClientResponse *HttpClient::request(string method, string path, string body) {
+  bool reused = connection.socket != NULL && connection.reused;
+  HTTPClientResponse *response = NULL;
+  try {
+    write_request(path, method, body);
+    response = read_response();
+    if (!reused || response->bytesRead() > 0) {
+      return response;
+    }
+  } catch (SocketWriteError &) {
+    if (!reused) {
+      throw;
+    }
+  }
+
+  // The server closed the idle connection before it got this request
+  delete response;
+  if (connection.socket != NULL) {
+    connection.close();
+  }
+  pending = 0;
+  connection = ConnectionPool::global()->connect(host, port);
+  write_request(path, method, body);
   return read_response();
 }
 
+HTTPClientResponse *HttpClient::get(string path) {
+  return request("GET", path, "");
+}
+
 HTTPClientResponse *HttpClient::post(string path, string body) {
-  write_request(path, "POST", body);
-  return read_response();
+  return request("POST", path, body);
 }
 
 HTTPClientResponse *HttpClient::put(string path, string body) {
-  write_request(path, "PUT", body);
-  return read_response();
+  return request("PUT", path, body);
 }
 
 HTTPClientResponse *HttpClient::del(string path) {
-  write_request(path, "DELETE", "");
-  return read_response();
+  return request("DELETE", path, "");
 }
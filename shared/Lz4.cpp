@@ -0,0 +1,162 @@
+#include <string.h>
+
+#include "Lz4.h"
+
+// LZ4 block format: a sequence is a token (literal length in the high nibble,
+// match length - 4 in the low nibble), extra literal length bytes when the
+// nibble is 15, the literals, a 2 byte little-endian match offset and extra
+// match length bytes. The last sequence has literals only; the last match
+// starts at least 12 bytes before the end and the last 5 bytes are literals.
+
+#define MIN_MATCH 4
+#define LAST_LITERALS 5
+#define MF_LIMIT 12
+#define MAX_OFFSET 65535
+#define HASH_LOG 12
+
+static inline uint32_t read32(const uint8_t *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static inline int hash32(uint32_t v) {
+  return (int) ((v * 2654435761u) >> (32 - HASH_LOG));
+}
+
+// Writes a length that didn't fit in its nibble as 255s plus a remainder
+static inline uint8_t *writeLength(uint8_t *op, int len) {
+  while (len >= 255) {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = (uint8_t) len;
+  return op;
+}
+
+static uint8_t *writeSequence(uint8_t *op, const uint8_t *literals, int literalLen, int offset, int matchLen) {
+  uint8_t *token = op++;
+  *token = (uint8_t) ((literalLen >= 15 ? 15 : literalLen) << 4);
+  if (literalLen >= 15) {
+    op = writeLength(op, literalLen - 15);
+  }
+  memcpy(op, literals, literalLen);
+  op += literalLen;
+
+  if (matchLen > 0) {
+    *op++ = (uint8_t) (offset & 0xff);
+    *op++ = (uint8_t) (offset >> 8);
+    int code = matchLen - MIN_MATCH;
+    *token |= (uint8_t) (code >= 15 ? 15 : code);
+    if (code >= 15) {
+      op = writeLength(op, code - 15);
+    }
+  }
+  return op;
+}
+
+int Lz4::compress(const uint8_t *src, int srcLen, uint8_t *dst, int dstCapacity) {
+  // Worst case output, so the loop never checks space per byte
+  int bound = srcLen + srcLen / 255 + 16;
+  uint8_t scratch[bound];
+  uint8_t *op = scratch;
+
+  const uint8_t *anchor = src;
+  const uint8_t *ip = src;
+  const uint8_t *matchLimit = src + srcLen - LAST_LITERALS;
+  const uint8_t *inputLimit = src + srcLen - MF_LIMIT;
+
+  int table[1 << HASH_LOG];
+  memset(table, -1, sizeof(table));
+
+  while (srcLen >= MF_LIMIT && ip < inputLimit) {
+    int h = hash32(read32(ip));
+    int candidate = table[h];
+    table[h] = (int) (ip - src);
+
+    if (candidate < 0 || ip - (src + candidate) > MAX_OFFSET || read32(src + candidate) != read32(ip)) {
+      ip++;
+      continue;
+    }
+
+    // Extend the match forwards as far as the format allows
+    const uint8_t *match = src + candidate;
+    int matchLen = MIN_MATCH;
+    while (ip + matchLen < matchLimit && ip[matchLen] == match[matchLen]) {
+      matchLen++;
+    }
+
+    op = writeSequence(op, anchor, (int) (ip - anchor), (int) (ip - match), matchLen);
+    ip += matchLen;
+    anchor = ip;
+  }
+
+  op = writeSequence(op, anchor, (int) (src + srcLen - anchor), 0, 0);
+
+  int written = (int) (op - scratch);
+  if (written > dstCapacity) {
+    return 0;
+  }
+  memcpy(dst, scratch, written);
+  return written;
+}
+
+int Lz4::decompress(const uint8_t *src, int srcLen, uint8_t *dst, int dstLen) {
+  const uint8_t *ip = src;
+  const uint8_t *ipEnd = src + srcLen;
+  uint8_t *op = dst;
+  uint8_t *opEnd = dst + dstLen;
+
+  while (ip < ipEnd) {
+    int token = *ip++;
+
+    int literalLen = token >> 4;
+    if (literalLen == 15) {
+      int b;
+      do {
+        if (ip >= ipEnd) return -1;
+        b = *ip++;
+        literalLen += b;
+      } while (b == 255);
+    }
+    if (literalLen > ipEnd - ip || literalLen > opEnd - op) {
+      return -1;
+    }
+    memcpy(op, ip, literalLen);
+    ip += literalLen;
+    op += literalLen;
+
+    if (ip == ipEnd) {
+      break;  // the last sequence has no match
+    }
+
+    if (ipEnd - ip < 2) return -1;
+    int offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+    if (offset == 0 || offset > op - dst) {
+      return -1;
+    }
+
+    int matchLen = (token & 15) + MIN_MATCH;
+    if ((token & 15) == 15) {
+      int b;
+      do {
+        if (ip >= ipEnd) return -1;
+        b = *ip++;
+        matchLen += b;
+      } while (b == 255);
+    }
+    if (matchLen > opEnd - op) {
+      return -1;
+    }
+
+    // Byte by byte, matches may overlap their own output
+    const uint8_t *match = op - offset;
+    for (int i = 0; i < matchLen; i++) {
+      op[i] = match[i];
+    }
+    op += matchLen;
+  }
+
+  return op == opEnd ? dstLen : -1;
+}
@@ -1,8 +1,10 @@
 #include "MySocket.h"
 #include <sys/types.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
 #include <unistd.h>
 #include <string.h>
+#include <errno.h>
 #include <netdb.h>
 #include <netinet/in.h>
 #include <string>
@@ -80,6 +82,52 @@ void MySocket::write_bytes(const void *buffer, int len) {
     }
 }
 
+void MySocket::writev(const struct iovec *iov, int iovcnt) {
+    if (sockFd<0) {
+      throw SocketNotConnected();
+    }
+
+    // ::writev may stop part way through any buffer, so work on a copy
+    // that can be advanced past what has been sent
+    struct iovec pending[iovcnt];
+    memcpy(pending, iov, iovcnt * sizeof(struct iovec));
+    struct iovec *next = pending;
+    while (iovcnt > 0) {
+        if (next->iov_len == 0) {
+            next++;
+            iovcnt--;
+            continue;
+        }
+        ssize_t bytesWritten = ::writev(sockFd, next, iovcnt);
+        if (bytesWritten <= 0) {
+          throw SocketWriteError();
+        }
+        while (iovcnt > 0 && (size_t) bytesWritten >= next->iov_len) {
+            bytesWritten -= next->iov_len;
+            next++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            next->iov_base = (char *) next->iov_base + bytesWritten;
+            next->iov_len -= bytesWritten;
+        }
+    }
+}
+
+void MySocket::sendfile(int fd, off_t offset, size_t count) {
+    if (sockFd<0) {
+      throw SocketNotConnected();
+    }
+
+    while (count > 0) {
+        ssize_t bytesSent = ::sendfile(sockFd, fd, &offset, count);
+        if (bytesSent <= 0) {
+          throw SocketWriteError();
+        }
+        count -= bytesSent;
+    }
+}
+
 string MySocket::read() {
     char buffer[4096];
     if(sockFd<0) {
@@ -95,6 +143,30 @@ string MySocket::read() {
     return string(buffer, ret);
 }
 
+size_t MySocket::readv(const struct iovec *iov, int iovcnt) {
+    if(sockFd<0) {
+      throw SocketNotConnected();
+    }
+
+    ssize_t ret = ::readv(sockFd, iov, iovcnt);
+
+    if(ret <= 0) {
+      throw SocketReadError();
+    }
+
+    return ret;
+}
+
+bool MySocket::stale() {
+    if(sockFd<0) {
+      return true;
+    }
+
+    char c;
+    ssize_t ret = recv(sockFd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    return !(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK));
+}
+
 void MySocket::close(void) {
     if(sockFd<0) return;
     
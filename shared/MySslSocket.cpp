@@ -3,6 +3,8 @@
 #include <iostream>
 #include <sstream>
 
+#include <unistd.h>
+
 #include <openssl/conf.h>
 #include <openssl/opensslconf.h>
 
@@ -74,6 +76,27 @@ void MySslSocket::write(string buffer) {
   }
 }
 
+void MySslSocket::writev(const struct iovec *iov, int iovcnt) {
+  // TLS records are built from one buffer at a time anyway
+  for (int i = 0; i < iovcnt; i++) {
+    write(string((const char *) iov[i].iov_base, iov[i].iov_len));
+  }
+}
+
+// The bytes have to be encrypted, so they come through user space after all
+void MySslSocket::sendfile(int fd, off_t offset, size_t count) {
+  char buffer[16 * 1024];
+  while (count > 0) {
+    ssize_t ret = pread(fd, buffer, count < sizeof(buffer) ? count : sizeof(buffer), offset);
+    if (ret <= 0) {
+      throw SocketWriteError();
+    }
+    write(string(buffer, ret));
+    offset += ret;
+    count -= ret;
+  }
+}
+
 string MySslSocket::read() {
   char buffer[4096];
   if(sockFd<0 || ssl == NULL) {
@@ -97,6 +120,28 @@ string MySslSocket::read() {
   return result;
 }
 
+// SSL_read hands back at most one record at a time, so only the first
+// buffer is filled
+size_t MySslSocket::readv(const struct iovec *iov, int iovcnt) {
+  if(sockFd<0 || ssl == NULL) {
+    throw SocketNotConnected();
+  }
+
+  int ret = iovcnt > 0 ? SSL_read(ssl, iov[0].iov_base, iov[0].iov_len) : 0;
+
+  if(ret <= 0) {
+    throw SocketReadError();
+  }
+
+  if (debug_print_io) {
+    cout << "MySslSocket::readv" << endl;
+    cout << "------------------" << endl;
+    cout << string((const char *) iov[0].iov_base, ret) << endl << endl;
+  }
+
+  return ret;
+}
+
 void MySslSocket::close() {
   if(NULL != ctx)
     SSL_CTX_free(ctx);
@@ -0,0 +1,75 @@
+#include <string.h>
+#include <sys/uio.h>
+
+#include "SocketBuffer.h"
+
+using namespace std;
+
+SocketBuffer::SocketBuffer(size_t capacity) {
+  m_capacity = capacity > 0 ? capacity : 1;
+  m_data = new char[m_capacity];
+  m_start = 0;
+  m_size = 0;
+}
+
+SocketBuffer::~SocketBuffer() {
+  delete [] m_data;
+}
+
+size_t SocketBuffer::fill(MySocket *sock) {
+  if (m_size == m_capacity) {
+    grow(m_capacity * 2);
+  }
+
+  // The free space runs from the end of the data to the end of the buffer
+  // and then on from the start of the buffer, unless the data wraps
+  size_t end = (m_start + m_size) % m_capacity;
+  struct iovec iov[2];
+  int iovcnt = 1;
+  iov[0].iov_base = m_data + end;
+  if (end < m_start || (end == m_start && m_size > 0)) {
+    iov[0].iov_len = m_start - end;
+  } else {
+    iov[0].iov_len = m_capacity - end;
+    if (m_start > 0) {
+      iov[1].iov_base = m_data;
+      iov[1].iov_len = m_start;
+      iovcnt = 2;
+    }
+  }
+
+  size_t bytesRead = sock->readv(iov, iovcnt);
+  m_size += bytesRead;
+  return bytesRead;
+}
+
+const char *SocketBuffer::data(size_t *len) {
+  *len = m_size < m_capacity - m_start ? m_size : m_capacity - m_start;
+  return m_data + m_start;
+}
+
+void SocketBuffer::consume(size_t len) {
+  if (len >= m_size) {
+    clear();
+    return;
+  }
+  m_start = (m_start + len) % m_capacity;
+  m_size -= len;
+}
+
+void SocketBuffer::clear() {
+  // Starting over at the front keeps the next read in one piece
+  m_start = 0;
+  m_size = 0;
+}
+
+void SocketBuffer::grow(size_t capacity) {
+  char *data = new char[capacity];
+  size_t first = m_size < m_capacity - m_start ? m_size : m_capacity - m_start;
+  memcpy(data, m_data + m_start, first);
+  memcpy(data + first, m_data, m_size - first);
+  delete [] m_data;
+  m_data = data;
+  m_capacity = capacity;
+  m_start = 0;
+}
@@ -0,0 +1,51 @@
+#ifndef _CONNECTIONPOOL_H_
+#define _CONNECTIONPOOL_H_
+
+#include <pthread.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "MySocket.h"
+#include "SocketBuffer.h"
+
+// A client connection and the buffer its responses are read through, which
+// has to stay with it: bytes of the next response may already be in there
+struct HttpConnection {
+  MySocket *socket;
+  SocketBuffer *buffer;
+  bool reused;  // came out of the pool rather than a fresh connect
+
+  // Closes the socket and frees both
+  void close();
+};
+
+/**
+ * Idle keep-alive connections, kept by host:port so the next request to
+ * the same server can skip the connect. Safe to share between threads.
+ */
+class ConnectionPool {
+ public:
+  ConnectionPool(int maxIdlePerHost = 8);
+  ~ConnectionPool();
+
+  // An idle connection to host:port if there is a live one, otherwise a new
+  // connection. Throws SocketError if connecting fails.
+  HttpConnection acquire(const std::string &host, int port);
+  // A new connection to host:port, never one from the pool
+  HttpConnection connect(const std::string &host, int port);
+  // Takes back a connection that is between responses, closing it if
+  // enough connections to host:port are idle already
+  void release(const std::string &host, int port, HttpConnection connection);
+
+  // The pool HttpClient uses
+  static ConnectionPool *global();
+
+ private:
+  int m_maxIdlePerHost;
+  pthread_mutex_t m_lock;
+  std::map<std::string, std::vector<HttpConnection> > m_idle;
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _CRC32C_H_
+#define _CRC32C_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * CRC-32C (Castagnoli), the checksum used by iSCSI, ext4 and btrfs.
+ *
+ * Uses the SSE 4.2 crc32 instruction when the CPU has it and a table
+ * otherwise; both give the same result.
+ */
+class Crc32c {
+public:
+  // The CRC-32C of len bytes at data
+  static uint32_t compute(const void *data, size_t len);
+};
+
+#endif
@@ -0,0 +1,19 @@
+#ifndef _GZIP_H_
+#define _GZIP_H_
+
+#include <stddef.h>
+
+#include <string>
+
+/**
+ * gzip (RFC 1952) encoding of HTTP bodies, for Content-Encoding: gzip.
+ * A thin wrapper over zlib's deflate.
+ */
+class Gzip {
+public:
+  // The gzip stream for len bytes at data, at a zlib level from 1 (fastest)
+  // to 9 (smallest)
+  static std::string compress(const void *data, size_t len, int level = 6);
+};
+
+#endif
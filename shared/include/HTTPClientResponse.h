@@ -2,24 +2,48 @@
 #define HTTP_CLIENT_REQUEST_H_
 
 #include "MySocket.h"
+#include "SocketBuffer.h"
 
 #include <map>
 #include <string>
 
 class HTTPClientResponse {
  public:
-  HTTPClientResponse(MySocket *sock);    
+  // Reads through buffer, the connection's, if there is one. Without one
+  // the response is read to the end of the connection.
+  HTTPClientResponse(MySocket *sock, SocketBuffer *buffer = NULL);
+  ~HTTPClientResponse();
+  // Reads one response, framed by Content-Length, chunked encoding or the
+  // end of the connection, and returns its body
   std::string readResponse();
   int status() { return m_status_code; }
   bool success() { return m_status_code >= 200 && m_status_code < 300; }
   std::string body() { return m_body; }
-  
+  // The value of header name (case-insensitive), "" if it wasn't sent
+  std::string header(std::string name);
+  // Whether the connection can carry another request: the whole response
+  // was read and the server didn't ask to close
+  bool keepAlive() { return m_keep_alive; }
+  // Bytes that arrived on the socket for this response
+  unsigned long bytesRead() { return m_bytes_read; }
+
  protected:
+  bool fill();
+  bool readLine(std::string &line);
+  bool readBytes(size_t len);
+  bool readChunked();
+  bool readHead();
+
   MySocket *m_sock;
+  SocketBuffer *m_buffer;
+  bool m_owns_buffer;
   std::string m_body;
-  std::map<std::string, std::string> m_headers;
+  std::map<std::string, std::string> m_headers;  // names lowercased
   int m_status_code;
   std::string m_status_message;
+  std::string m_version;
+  bool m_keep_alive;
+  unsigned long m_bytes_read;
 };
 
 #endif
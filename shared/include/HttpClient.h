@@ -4,6 +4,7 @@
 #include <string>
 #include <map>
 
+#include "ConnectionPool.h"
 #include "HTTPClientResponse.h"
 #include "MySocket.h"
 
@@ -14,10 +15,13 @@ class HttpClient {
    *
    * The constructor accepts a string representation of and ip address
    * ("192.168.0.1") or domain name ("www.cs.udavis.edu") and
-   * connects.  Will throw an HostNotFound exception if the attepted
-   * connection fails.
+   * connects, or takes an idle keep-alive connection to the same
+   * server from ConnectionPool::global().  Will throw an HostNotFound
+   * exception if the attepted connection fails.
    *
    * Note: this call will block while establishing a connection.
+   * The connection goes back to the pool when the client is deleted,
+   * if the server let it stay open.
    *
    * @param inetAddr either ip address, or the domain name
    * @param port the port to connect to
@@ -94,11 +98,31 @@ class HttpClient {
    */
   void set_header(std::string key, std::string value);
   
+  /**
+   * Pipelining
+   *
+   * write_request sends a request without waiting for the answer, so
+   * several can be written before read_response reads their responses,
+   * in the same order. The body overload sends length bytes at body as
+   * they are, e.g. from an mmap'd file, without copying them.
+   *
+   * Only pipeline once a response has said keepAlive(). If a response
+   * ends the connection, the requests written after it are lost and
+   * have to be written again; the next write_request reconnects.
+   */
   void write_request(std::string path, std::string method, std::string body);
+  void write_request(std::string path, std::string method, const char *body, size_t length);
   HTTPClientResponse *read_response();
   
  private:
-  MySocket *connection;
+  // write_request and read_response, again on a new connection if a
+  // pooled one turns out to have been closed by the server
+  HTTPClientResponse *request(std::string method, std::string path, std::string body);
+
+  std::string host;
+  int port;
+  HttpConnection connection;  // socket NULL between connections
+  int pending;  // requests out whose responses aren't read yet
   std::map<std::string, std::string> headers;
 };
   
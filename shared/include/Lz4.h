@@ -0,0 +1,23 @@
+#ifndef _LZ4_H_
+#define _LZ4_H_
+
+#include <stdint.h>
+
+/**
+ * A small compressor for the LZ4 block format (no frame, no checksum).
+ *
+ * Output is readable by any LZ4 block decoder and decompress() accepts any
+ * valid LZ4 block, but it is tuned for the short inputs the file system
+ * gives it: one disk block at a time.
+ */
+class Lz4 {
+public:
+  // Compresses srcLen bytes into dst. Returns the compressed length, or 0 if
+  // the result would not fit in dstCapacity bytes.
+  static int compress(const uint8_t *src, int srcLen, uint8_t *dst, int dstCapacity);
+  // Decompresses a block that expands to exactly dstLen bytes. Returns
+  // dstLen, or -1 if the input is corrupt or doesn't match dstLen.
+  static int decompress(const uint8_t *src, int srcLen, uint8_t *dst, int dstLen);
+};
+
+#endif
@@ -3,6 +3,8 @@
 
 #include <stdexcept>
 #include <string>
+#include <sys/types.h>
+#include <sys/uio.h>
 
 class SocketNotConnected : public std::runtime_error {
  public:
@@ -50,8 +52,30 @@ class MySocket {
 
 
   virtual std::string read();
+  /*
+   * reads whatever has arrived, up to the total size of the iovcnt buffers
+   * in iov, straight into them with one system call, and returns how many
+   * bytes that was
+   */
+  virtual size_t readv(const struct iovec *iov, int iovcnt);
   virtual void write(std::string data);
+  /*
+   * writes the iovcnt buffers in iov, in order, with as few system calls as
+   * the kernel allows and without copying them into one buffer first
+   */
+  virtual void writev(const struct iovec *iov, int iovcnt);
+  /*
+   * writes count bytes of the file open on fd, starting at offset, with
+   * sendfile, so they go from the page cache to the socket without being
+   * copied through user space
+   */
+  virtual void sendfile(int fd, off_t offset, size_t count);
   virtual void close(void);
+  /*
+   * true if this connection is no use for another request: closed, closed
+   * by the peer, or with bytes waiting that nobody asked for
+   */
+  bool stale();
   
  protected:
   void call_connect(const char *inetAddr, int port);
@@ -0,0 +1,45 @@
+#ifndef _SOCKETBUFFER_H_
+#define _SOCKETBUFFER_H_
+
+#include <stddef.h>
+
+#include "MySocket.h"
+
+/**
+ * A ring buffer that socket reads land in and parsers read from in place.
+ *
+ * One buffer serves a whole connection and can be reused for the next, so
+ * reading a request costs no allocation. Each fill() is one readv over all
+ * the free space, both pieces of it when the free space wraps around.
+ */
+class SocketBuffer {
+ public:
+  SocketBuffer(size_t capacity = 64 * 1024);
+  ~SocketBuffer();
+
+  // Reads what the socket has, as much as fits, and returns how much that
+  // was. Doubles the buffer first if it is full. Throws what
+  // MySocket::readv throws.
+  size_t fill(MySocket *sock);
+  // The oldest unconsumed bytes that are contiguous in memory; *len is set
+  // to how many there are. There may be more after them once these are
+  // consumed.
+  const char *data(size_t *len);
+  // Drops the first len unconsumed bytes
+  void consume(size_t len);
+  // Drops everything, for a new connection
+  void clear();
+
+  size_t size() { return m_size; }
+  size_t capacity() { return m_capacity; }
+
+ private:
+  void grow(size_t capacity);
+
+  char *m_data;
+  size_t m_capacity;
+  size_t m_start;  // of the unconsumed bytes
+  size_t m_size;   // of the unconsumed bytes
+};
+
+#endif
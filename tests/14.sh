@@ -0,0 +1,22 @@
+#!/bin/bash
+set -e
+
+# Grow the root directory into a second block, then remove entries and make
+# sure freed slots are reused and the empty trailing block is returned.
+./mkfs -f test.img -i 256 -d 32 > /dev/null
+
+for i in $(seq 1 130); do
+    ./ds3touch test.img 0 f$i
+done
+./ds3bits test.img | tail -1
+
+for i in $(seq 1 130); do
+    if [ $((i % 10)) != 0 ]; then
+        ./ds3rm test.img 0 f$i
+    fi
+done
+./ds3bits test.img | tail -1
+
+./ds3touch test.img 0 again1
+./ds3touch test.img 0 again2
+./ds3ls test.img /
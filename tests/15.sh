@@ -0,0 +1,16 @@
+#!/bin/bash
+set -e
+
+# Names longer than 27 bytes on an image made with long-name directories
+./mkfs -l -f test.img -i 64 -d 32 > /dev/null
+
+./ds3mkdir test.img 0 3f2a9c4e-1b7d-4e0a-8c6f-2d9e5b1a7c3e
+./ds3touch test.img 1 sha256-9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08.json
+./ds3touch test.img 1 manifest.json
+./ds3touch test.img 1 sha256-60303ae22b998861bce3b28f33eec1be758a213c86c93c076dbe9f558c11c752.json
+./ds3ls test.img /
+./ds3ls test.img /3f2a9c4e-1b7d-4e0a-8c6f-2d9e5b1a7c3e
+./ds3ls test.img /3f2a9c4e-1b7d-4e0a-8c6f-2d9e5b1a7c3e/sha256-9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08.json
+
+./ds3rm test.img 1 sha256-9f86d081884c7d659a2feaa0c55ad015a3bf4f1b2b0b822cd15d6c15b0f00a08.json
+./ds3ls test.img /3f2a9c4e-1b7d-4e0a-8c6f-2d9e5b1a7c3e
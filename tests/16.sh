@@ -0,0 +1,23 @@
+#!/bin/bash
+set -e
+
+# Small files live in the inode on images made with inline data, and move
+# in and out of data blocks as they grow and shrink
+./mkfs -s -f test.img > /dev/null
+printf '{"name":"manifest","version":3,"parts":["a","b"]}' > test.small
+
+./ds3touch test.img 0 manifest.json
+./ds3cp test.img test.small 1
+./ds3cat test.img 1
+echo
+./ds3bits test.img | tail -1
+
+./ds3cp test.img tests/6kwords.txt 1
+./ds3cat test.img 1 | head -4
+./ds3bits test.img | tail -1
+
+./ds3cp test.img test.small 1
+./ds3cat test.img 1
+echo
+./ds3bits test.img | tail -1
+rm -f test.small
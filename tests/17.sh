@@ -0,0 +1,32 @@
+#!/bin/bash
+set -e
+
+# Rename within a directory, move across directories (updating '..'), replace
+# an existing file, and the moves that must be refused, in both entry formats
+for flags in "" "-l"; do
+    ./mkfs $flags -f test.img -i 64 -d 32 > /dev/null
+
+    ./ds3mkdir test.img 0 a      # 1
+    ./ds3mkdir test.img 1 b      # 2
+    ./ds3touch test.img 0 f.txt  # 3
+    ./ds3cp test.img tests/6kwords.txt 3
+    ./ds3touch test.img 1 g.txt  # 4
+    ./ds3bits test.img | tail -1
+
+    ./ds3mv test.img 0 f.txt 0 renamed.txt
+    ./ds3mv test.img 0 renamed.txt 2 f.txt
+    ./ds3mv test.img 1 b 0 b
+    ./ds3ls test.img /
+    ./ds3ls test.img /b
+    ./ds3cat test.img 3 | head -2
+
+    ./ds3mv test.img 1 g.txt 2 f.txt
+    ./ds3ls test.img /b
+    ./ds3bits test.img | tail -1
+
+    ./ds3mv test.img 0 b 2 b 2>&1 || true
+    ./ds3mv test.img 0 a 2 a
+    ./ds3mv test.img 0 b 1 b 2>&1 || true
+    ./ds3mv test.img 0 missing 0 other 2>&1 || true
+    ./ds3ls test.img /b/a
+done
@@ -0,0 +1,26 @@
+#!/bin/bash
+set -e
+
+# Copies share data blocks on images with reference counts and get their own
+# block on the first write; other images copy the blocks up front
+for flags in "-c" ""; do
+    ./mkfs $flags -f test.img > /dev/null
+    printf 'version 2\n' > test.small
+
+    ./ds3touch test.img 0 v1.txt  # 1
+    ./ds3touch test.img 0 v2.txt  # 2
+    ./ds3cp test.img tests/6kwords.txt 1
+    ./ds3clone test.img 1 2
+    ./ds3cat test.img 2 | head -5
+    ./ds3bits test.img | tail -1
+
+    ./ds3cp test.img test.small 2
+    ./ds3cat test.img 2
+    ./ds3cat test.img 1 | head -5
+    ./ds3bits test.img | tail -1
+
+    ./ds3rm test.img 0 v1.txt
+    ./ds3bits test.img | tail -1
+    ./ds3clone test.img 0 2 2>&1 || true
+done
+rm -f test.small
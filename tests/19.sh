@@ -0,0 +1,30 @@
+#!/bin/bash
+set -e
+
+# On dedup images identical blocks are stored once, within a file and across
+# files, and stay shared until they are rewritten or the last owner goes
+./mkfs -u -f test.img
+head -c 4096 tests/6kwords.txt > test.block
+cat test.block test.block test.block > test.dup
+head -c 5000 tests/6kwords.txt >> test.dup
+printf 'version 2\n' > test.small
+
+./ds3touch test.img 0 a.bin  # 1
+./ds3touch test.img 0 b.bin  # 2
+./ds3cp test.img test.dup 1
+./ds3cat test.img 1 | head -7
+./ds3bits test.img | tail -1
+
+./ds3cp test.img test.dup 2
+./ds3cat test.img 2 | head -7
+./ds3bits test.img | tail -1
+
+./ds3cp test.img test.small 1
+./ds3cat test.img 1
+./ds3rm test.img 0 b.bin
+./ds3bits test.img | tail -1
+
+./ds3cp test.img test.dup 1
+./ds3cat test.img 1 | head -7
+./ds3bits test.img | tail -1
+rm -f test.block test.dup test.small
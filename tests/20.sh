@@ -0,0 +1,27 @@
+#!/bin/bash
+set -e
+
+# Files are stored LZ4 compressed on images made with compression when that
+# takes fewer blocks, and read back transparently
+./mkfs -z -f test.img > /dev/null
+for i in $(seq 1 2000); do
+    echo "{\"id\": $i, \"status\": \"ok\", \"tags\": [\"alpha\", \"beta\"]}"
+done > test.json
+wc -c < test.json
+
+./ds3touch test.img 0 records.json  # 1
+./ds3touch test.img 0 copy.json     # 2
+./ds3cp test.img test.json 1
+./ds3cat test.img 1 | sed -n '1,/^$/p'
+./ds3cat test.img 1 | sed '1,/^File data$/d' | cmp - test.json && echo "same contents"
+./ds3bits test.img | tail -1
+
+./ds3clone test.img 1 2
+./ds3cat test.img 2 | sed '1,/^File data$/d' | cmp - test.json && echo "same contents"
+./ds3bits test.img | tail -1
+
+./ds3cp test.img tests/6kwords.txt 1
+./ds3cat test.img 1 | sed -n '1,/^$/p'
+./ds3cat test.img 1 | sed '1,/^File data$/d' | cmp - tests/6kwords.txt && echo "same contents"
+./ds3bits test.img | tail -1
+rm -f test.json
@@ -0,0 +1,36 @@
+#!/bin/bash
+set -e
+
+# Images made with checksums record a CRC-32C for every file block and
+# reads refuse a block that no longer matches it
+for flags in "-k" "-k -z"; do
+    ./mkfs $flags -f test.img > /dev/null
+    ./ds3touch test.img 0 words.txt  # 1
+    ./ds3touch test.img 0 copy.txt   # 2
+    ./ds3cp test.img tests/6kwords.txt 1
+    ./ds3clone test.img 1 2
+    ./ds3cat test.img 2 | sed '1,/^File data$/d' | cmp - tests/6kwords.txt && echo "same contents"
+
+    # flip a byte in the middle of the first block of the copy
+    block=$(./ds3cat test.img 2 | sed -n 2p)
+    printf 'X' | dd of=test.img bs=1 seek=$((block * 4096 + 100)) conv=notrunc 2> /dev/null
+    ./ds3cat test.img 2 > /dev/null 2>&1 || echo "copy is corrupt"
+    ./ds3cat test.img 1 | sed '1,/^File data$/d' | cmp - tests/6kwords.txt && echo "original is fine"
+
+    # rewriting the file replaces the bad block
+    ./ds3cp test.img tests/6kwords.txt 2
+    ./ds3cat test.img 2 | sed '1,/^File data$/d' | cmp - tests/6kwords.txt && echo "same contents"
+done
+
+# a rewrite that runs out of space changes nothing, so the old blocks
+# still match their checksums
+./mkfs -k -d 32 -f test.img > /dev/null
+for i in $(seq 1 10); do
+    ./ds3touch test.img 0 f$i.txt
+    ./ds3cp test.img tests/6kwords.txt $i
+done
+twice=$(mktemp)
+cat tests/6kwords.txt tests/6kwords.txt > $twice
+./ds3cp test.img $twice 1 2> /dev/null || true  # there are 2 blocks more to find, and 1 free
+rm -f $twice
+./ds3cat test.img 1 | sed '1,/^File data$/d' | cmp - tests/6kwords.txt && echo "old contents kept"
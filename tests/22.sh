@@ -0,0 +1,32 @@
+#!/bin/bash
+set -e
+
+# POST /ds3/?batch runs each operation in turn and answers for each; one
+# that fails is undone on its own and the rest still run
+./mkfs -f test.img > /dev/null
+. tests/server.sh
+
+big=$(mktemp)
+head -c 130000 /dev/zero > $big  # more than a file can hold
+{
+    printf 'PUT /docs/a.txt 6\nhello\n'
+    printf 'PUT /docs 3\nabc'             # a directory, so 409
+    printf 'PUT /new/dir/big.bin 130000\n'
+    cat $big                             # creates /new/dir, then 507
+    printf 'GET /docs/a.txt\n'
+    printf 'DELETE /docs/missing.txt\n'  # 404
+    printf 'PUT /docs/b.txt 3\nbye'
+    printf 'GET /docs/\n'
+    printf 'GET /\n'
+} > $big.batch
+curl -s -D $big.head -X POST --data-binary @$big.batch "$url/?batch"
+grep -i '^Content-Type' $big.head | tr -d '\r'
+rm -f $big $big.batch $big.head
+
+# what the batch left behind
+curl -s $url/
+curl -s $url/docs/b.txt; echo
+
+# a batch that doesn't parse is refused whole
+printf 'PUT /docs/c.txt 100\nshort' | curl -s -o /dev/null -w '%{http_code}\n' -X POST --data-binary @- "$url/?batch"
+curl -s -o /dev/null -w '%{http_code}\n' $url/docs/c.txt
@@ -0,0 +1,29 @@
+#!/bin/bash
+set -e
+
+# On images with versions every file has an ETag, and GET and PUT honor
+# If-None-Match, If-Match and If-Modified-Since
+./mkfs -e -f test.img > /dev/null
+. tests/server.sh
+status() { curl -s -o /dev/null -w '%{http_code}\n' "$@"; }
+
+curl -s -D - -o /dev/null -X PUT --data-binary 'first' $url/notes.txt | grep -i '^ETag' | tr -d '\r'
+tag=$(curl -s -D - -o /dev/null $url/notes.txt | grep -i '^ETag' | cut -d' ' -f2 | tr -d '\r')
+echo "GET ETag $tag"
+
+status -H "If-None-Match: $tag" $url/notes.txt                 # 304
+status -H 'If-None-Match: "other", '"W/$tag" $url/notes.txt   # 304, compared weakly
+status -H 'If-None-Match: "other"' $url/notes.txt              # 200
+status -H 'If-Modified-Since: Fri, 01 Jan 2100 00:00:00 GMT' $url/notes.txt  # 304
+status -H 'If-Modified-Since: Thu, 01 Jan 1970 00:00:00 GMT' $url/notes.txt  # 200
+
+# writes: If-Match must name the current version, If-None-Match: * only
+# creates
+status -X PUT --data-binary 'lost' -H 'If-Match: "other"' $url/notes.txt      # 412
+status -X PUT --data-binary 'second' -H "If-Match: $tag" $url/notes.txt        # 200
+status -X PUT --data-binary 'third' -H "If-Match: $tag" $url/notes.txt         # 412, stale
+status -X PUT --data-binary 'new' -H 'If-None-Match: *' $url/notes.txt         # 412
+status -X PUT --data-binary 'new' -H 'If-None-Match: *' $url/other.txt         # 200
+status -X DELETE -H "If-Match: $tag" $url/notes.txt                            # 412
+curl -s $url/notes.txt; echo
+status -H "If-None-Match: $tag" $url/notes.txt                                 # 200, changed
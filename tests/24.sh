@@ -0,0 +1,28 @@
+#!/bin/bash
+set -e
+
+# HEAD says everything GET would but sends no body, whether or not the
+# object is in the response cache
+./mkfs -e -f test.img > /dev/null
+. tests/server.sh
+headers() {
+    curl -s -I "$@" | tr -d '\r' | grep -i -E '^(HTTP|Content-Length|ETag|X-DS3-Type|X-DS3-Cache)' | sort
+}
+
+curl -s -o /dev/null -X PUT --data-binary @tests/6kwords.txt $url/docs/words.txt
+curl -s -o /dev/null -X PUT --data-binary 'hi' $url/docs/hi.txt
+
+headers $url/docs/words.txt
+curl -s -o /dev/null $url/docs/words.txt  # now cached
+headers $url/docs/words.txt
+headers $url/docs/
+curl -s $url/docs/ | wc -c
+tag=$(curl -s -I $url/docs/words.txt | grep -i '^ETag' | cut -d' ' -f2 | tr -d '\r')
+headers -H "If-None-Match: $tag" $url/docs/words.txt
+headers $url/docs/missing.txt
+
+# the bytes on the wire: a head and nothing after it
+exec 3<> /dev/tcp/localhost/$port
+printf 'HEAD /ds3/docs/hi.txt HTTP/1.1\r\nHost: localhost\r\n\r\n' >&3
+tail -c 4 <&3 | od -c | head -1
+exec 3<&-
@@ -0,0 +1,37 @@
+#!/bin/bash
+set -e
+
+# gunrock_web -z gzips text responses for clients that accept gzip, under
+# an ETag with a -gz suffix; HEAD agrees with GET
+./mkfs -e -f test.img > /dev/null
+. tests/server.sh -z 4
+headers() {
+    curl -s -o /dev/null -D - "$@" | tr -d '\r' |
+        grep -i -E '^(HTTP|Content-Length|Content-Encoding|ETag|Vary)' | sort
+}
+gzip="Accept-Encoding: gzip"
+
+curl -s -o /dev/null -X PUT --data-binary @tests/6kwords.txt $url/docs/words.txt
+curl -s -o /dev/null -X PUT --data-binary @tests/6kwords.txt $url/docs/other.txt
+curl -s -o /dev/null -X PUT --data-binary 'hi' $url/docs/hi.txt
+
+echo "GET, gzip"
+headers -H "$gzip" $url/docs/words.txt
+echo "HEAD, gzip, once GET compressed it"
+headers -I -H "$gzip" $url/docs/words.txt
+echo "HEAD, gzip, before any GET"
+headers -I -H "$gzip" $url/docs/other.txt
+echo "GET, identity"
+headers $url/docs/words.txt
+echo "HEAD, identity"
+headers -I $url/docs/words.txt
+echo "too small to compress"
+headers -H "$gzip" $url/docs/hi.txt
+
+curl -s -H "$gzip" $url/docs/words.txt | zcat | cmp - tests/6kwords.txt && echo "gzip body matches"
+
+echo "If-None-Match"
+curl -s -o /dev/null -w '%{http_code}\n' -H "$gzip" -H 'If-None-Match: "2-2-gz"' $url/docs/words.txt
+curl -s -o /dev/null -w '%{http_code}\n' -H "$gzip" -H 'If-None-Match: "2-2"' $url/docs/words.txt
+curl -s -o /dev/null -w '%{http_code}\n' -H 'If-None-Match: "2-2-gz"' $url/docs/words.txt
+curl -s -o /dev/null -w '%{http_code}\n' -I -H "$gzip" -H 'If-None-Match: "2-2-gz"' $url/docs/words.txt
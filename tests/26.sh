@@ -0,0 +1,69 @@
+#!/bin/bash
+set -e
+
+# PUT ?append adds to the end of a file on every kind of image, and an
+# overwrite writes only the blocks that changed
+head -c 100 tests/6kwords.txt > test.small
+tail -c 5000 tests/6kwords.txt > test.tail
+contents() {
+    ./ds3cat test.img $1 | sed '1,/^File data$/d'
+}
+append() {
+    curl -s -o /dev/null -w '%{http_code}\n' -X PUT --data-binary @$2 "$url/$1?append"
+}
+
+# out of an inline file and across a block boundary
+./mkfs -s -f test.img > /dev/null
+(
+    . tests/server.sh
+    curl -s -o /dev/null -X PUT --data-binary @test.small $url/f.txt  # 1
+    ./ds3cat test.img 1 | sed -n '1,/^$/p'
+    append f.txt tests/6kwords.txt
+    append f.txt test.tail
+)
+cat test.small tests/6kwords.txt test.tail | cmp - <(contents 1) && echo "same contents"
+./ds3bits test.img | tail -1
+
+# to a copy, which gets its own last block while the original keeps it
+./mkfs -c -f test.img > /dev/null
+(
+    . tests/server.sh
+    curl -s -o /dev/null -X PUT --data-binary @tests/6kwords.txt $url/f.txt      # 1
+    curl -s -o /dev/null -X PUT -H 'x-copy-source: /ds3/f.txt' $url/copy.txt      # 2
+    append copy.txt test.tail
+)
+cat tests/6kwords.txt test.tail | cmp - <(contents 2) && echo "copy appended"
+contents 1 | cmp - tests/6kwords.txt && echo "original unchanged"
+./ds3bits test.img | tail -1
+
+# on images whose blocks are compressed, shared or checksummed
+for flags in "-z" "-u" "-k" "-u -z -k"; do
+    ./mkfs $flags -f test.img > /dev/null
+    (
+        . tests/server.sh
+        curl -s -o /dev/null -X PUT --data-binary @tests/6kwords.txt $url/f.txt  # 1
+        curl -s -o /dev/null -X PUT --data-binary @tests/6kwords.txt $url/g.txt  # 2
+        append f.txt test.tail
+        append g.txt tests/6kwords.txt
+    )
+    cat tests/6kwords.txt test.tail | cmp - <(contents 1) && echo "$flags: same contents"
+    cat tests/6kwords.txt tests/6kwords.txt | cmp - <(contents 2) && echo "$flags: same contents"
+    ./ds3bits test.img | tail -1
+done
+
+# an overwrite that changes one block of three writes that block alone
+./mkfs -f test.img > /dev/null
+head -c 12288 /dev/zero | tr '\0' 'a' > test.old
+{ head -c 4096 test.old; head -c 4096 /dev/zero | tr '\0' 'b'; head -c 4096 test.old; } > test.new
+(
+    . tests/server.sh
+    writes() {
+        curl -s http://localhost:$port/metrics | grep '^gunrock_block_writes_total' | cut -d' ' -f2
+    }
+    curl -s -o /dev/null -X PUT --data-binary @test.old $url/f.bin  # 1
+    before=$(writes)
+    curl -s -o /dev/null -X PUT --data-binary @test.new $url/f.bin
+    echo "blocks written: $(($(writes) - before))"
+)
+contents 1 | cmp - test.new && echo "same contents"
+rm -f test.small test.tail test.old test.new
@@ -0,0 +1,37 @@
+#!/bin/bash
+set -e
+
+# The response cache, on by default, never answers with a body that a
+# PUT, DELETE, MOVE or batch has since changed
+./mkfs -f test.img > /dev/null
+. tests/server.sh
+show() {
+    for path in "$@"; do
+        curl -s -D /tmp/cache.$$ -o /tmp/body.$$ $url/$path
+        echo "/$path: $(grep -i '^X-DS3-Cache' /tmp/cache.$$ | cut -d' ' -f2 | tr -d '\r')" \
+             "$(head -1 /tmp/cache.$$ | cut -d' ' -f2) [$(tr '\n' ' ' < /tmp/body.$$)]"
+    done
+}
+
+curl -s -o /dev/null -X PUT --data-binary 'one' $url/d/f
+show "" d/ d/f   # cached
+show "" d/ d/f   # hits
+
+echo "PUT /d/g"
+curl -s -o /dev/null -X PUT --data-binary 'two' $url/d/g
+show "" d/ d/g
+echo "PUT /d/f"
+curl -s -o /dev/null -X PUT --data-binary 'three' $url/d/f
+show d/f
+echo "DELETE /d/f"
+curl -s -o /dev/null -X DELETE $url/d/f
+show d/ d/f
+echo "MOVE /d /e"
+show "" d/ d/g   # cached again
+curl -s -o /dev/null -X MOVE -H 'Destination: /ds3/e' $url/d
+show "" d/ d/g e/ e/g
+echo "batch PUT /e/g and /e/h"
+show "" e/ e/g   # cached again
+printf 'PUT /e/g 4\nfour''PUT /e/h 4\nfive' | curl -s -o /dev/null -X POST --data-binary @- "$url/?batch"
+show "" e/ e/g e/h
+rm -f /tmp/cache.$$ /tmp/body.$$
@@ -0,0 +1,53 @@
+#!/bin/bash
+set -e
+
+# FileService serves the files under -d from its cache while they stay
+# the same on disk, and sends big ones with sendfile
+./mkfs -f test.img > /dev/null
+top=$(mktemp -d)
+dir=$top/site
+mkdir $dir
+echo "secret" > $top/secret.txt
+. tests/server.sh -d $dir
+trap 'kill $server 2> /dev/null; wait $server 2> /dev/null || true; rm -rf $top' EXIT
+site=http://localhost:$port
+status() {
+    curl -s -o /dev/null -w '%{http_code} %{size_download}\n' "$@"
+}
+
+echo "empty file"
+: > $dir/empty.txt
+status $site/empty.txt
+echo "outside the directory"
+status --path-as-is $site/../secret.txt
+status $site/missing.txt
+
+echo "If-None-Match"
+echo "hello" > $dir/a.txt
+tag=$(curl -s -I $site/a.txt | grep -i '^ETag' | cut -d' ' -f2 | tr -d '\r')
+status -H "If-None-Match: $tag" $site/a.txt
+status -H 'If-None-Match: "other"' $site/a.txt
+
+echo "bigger than SENDFILE_THRESHOLD"
+for i in $(seq 1 10); do cat tests/6kwords.txt; done > $dir/big.txt
+curl -s $site/big.txt | cmp - $dir/big.txt && echo "same contents"
+curl -s -I $site/big.txt | grep -i '^Content-Length' | tr -d '\r'
+
+echo "edited"
+curl -s $site/a.txt
+echo "jello" > $dir/a.txt
+touch -d '+1 second' $dir/a.txt
+curl -s $site/a.txt
+status -H "If-None-Match: $tag" $site/a.txt
+
+echo "precompressed sibling"
+for i in $(seq 1 20); do echo "line $i"; done > $dir/b.txt
+gzip -c $dir/b.txt > $dir/b.txt.gz
+touch -d '2020-01-01 00:00:00' $dir/b.txt
+touch -d '2020-01-01 00:00:01' $dir/b.txt.gz
+curl -s -D - -o /dev/null -H 'Accept-Encoding: gzip' $site/b.txt | grep -i -E '^(Content-Encoding|Vary)' | tr -d '\r' | sort
+curl -s -H 'Accept-Encoding: gzip' $site/b.txt | zcat | cmp - $dir/b.txt && echo "same contents"
+curl -s $site/b.txt | cmp - $dir/b.txt && echo "same contents without gzip"
+touch -d '2020-01-01 00:00:02' $dir/b.txt  # now the sibling is stale
+curl -s -D - -o /dev/null -H 'Accept-Encoding: gzip' $site/b.txt | grep -i -E '^(Content-Encoding|Vary)' | tr -d '\r' | sort
+curl -s -H 'Accept-Encoding: gzip' $site/b.txt | cmp - $dir/b.txt && echo "same contents"
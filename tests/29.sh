@@ -0,0 +1,88 @@
+#!/bin/bash
+set -e
+
+# HttpClient against a server that keeps connections open: pipelined
+# responses framed by chunks and by Content-Length, pooled connections
+# handed from one client to the next, and a pooled connection the server
+# has closed being retried on a new one. gunrock_web closes every
+# connection, so a small stand-in server answers here and logs what it got.
+make -s loadgen bulkcp > /dev/null  # not part of make all
+dir=$(mktemp -d)
+port=$((20000 + RANDOM % 20000))
+python3 - $port $dir > $dir/log 2>&1 <<'PY' &
+import socket, socketserver, sys, threading
+
+port, dir = int(sys.argv[1]), sys.argv[2]
+bodies = {"/ds3/dir/": b"a\nb\n", "/ds3/dir/a": b"chunked body\n" * 50,
+          "/ds3/dir/b": b"counted body\n" * 30, "/ds3/stale": b"once\n"}
+lock = threading.Lock()
+connections = 0
+
+class Handler(socketserver.BaseRequestHandler):
+    def handle(self):
+        global connections
+        with lock:
+            connections += 1
+            number = connections
+        data = b""
+        while True:
+            while b"\r\n\r\n" not in data:
+                more = self.request.recv(65536)
+                if not more:
+                    return
+                data += more
+            head, data = data.split(b"\r\n\r\n", 1)
+            method, path = head.split(b" ")[:2]
+            path = path.decode()
+            with lock:
+                print("connection %d: %s %s" % (number, method.decode(), path), flush=True)
+            body = bodies.get(path, b"")
+            out = b"HTTP/1.1 200 OK\r\n"
+            if path == "/ds3/dir/a":
+                out += b"Transfer-Encoding: chunked\r\n\r\n"
+                for start in range(0, len(body), 256):
+                    piece = body[start:start + 256]
+                    out += b"%x\r\n" % len(piece) + piece + b"\r\n"
+                out += b"0\r\n\r\n"
+            else:
+                out += b"Content-Length: %d\r\n\r\n" % len(body) + body
+            self.request.sendall(out)
+            if path == "/ds3/stale":
+                return  # closes the connection the client has pooled
+
+socketserver.ThreadingTCPServer.allow_reuse_address = True
+server = socketserver.ThreadingTCPServer(("localhost", port), Handler)
+open(dir + "/ready", "w").close()
+server.serve_forever()
+PY
+server=$!
+trap 'kill $server 2> /dev/null; wait $server 2> /dev/null || true; rm -rf $dir' EXIT
+for i in $(seq 1 50); do
+    [ -e $dir/ready ] && break
+    sleep 0.1
+done
+seen=0
+# The requests the server got since last time, connections numbered from 1
+requests() {
+    tail -n +$((seen + 1)) $dir/log | awk '{if (!($2 in n)) n[$2] = ++count; print "connection " n[$2] " " $3, $4}'
+    seen=$(wc -l < $dir/log)
+}
+statuses() {
+    grep -E '^(replaying|GET)' | awk '/^GET/ {print $1, $NF; next} {print}' | sed "s@$dir@DIR@"
+}
+
+echo "bulkcp: a listing, then two responses pipelined on its connection"
+./bulkcp -p $port -c 1 get /dir $dir/got > /dev/null
+requests
+for i in $(seq 1 50); do echo "chunked body"; done | cmp - $dir/got/a && echo "a: same contents"
+for i in $(seq 1 30); do echo "counted body"; done | cmp - $dir/got/b && echo "b: same contents"
+
+echo "loadgen: two clients, one pooled connection"
+printf 'GET /ds3/dir/a\nGET /ds3/dir/b\n' > $dir/replay
+./loadgen -p $port -c 1 -r $dir/replay | statuses
+requests
+
+echo "loadgen: the pooled connection closed, so the next request reconnects"
+printf 'GET /ds3/stale\nGET /ds3/dir/b\n' > $dir/replay
+./loadgen -p $port -c 1 -r $dir/replay | statuses
+requests
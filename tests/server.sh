@@ -0,0 +1,11 @@
+# Sourced by the tests that talk HTTP: starts gunrock_web on test.img and
+# sets url to its /ds3/. The server goes when the test exits.
+port=$((20000 + RANDOM % 20000))
+./gunrock_web -p $port -i test.img -d static "$@" > /dev/null 2>&1 &
+server=$!
+trap 'kill $server 2> /dev/null; wait $server 2> /dev/null || true' EXIT
+url=http://localhost:$port/ds3
+for i in $(seq 1 50); do
+    curl -s -o /dev/null $url/ && break
+    sleep 0.1
+done